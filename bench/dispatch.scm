@@ -0,0 +1,33 @@
+; Call-heavy: about a million calls, each of which goes through an if, a let,
+; a quote and a lambda, so the time is mostly spent deciding what kind of
+; expression is being evaluated rather than doing any work.
+(define double
+  (lambda (list acc)
+    (if (null? list)
+        acc
+        (double (cdr list) (cons 1 (cons 1 acc))))))
+(define grow
+  (lambda (list times)
+    (if (null? times)
+        list
+        (grow (double list (quote ())) (cdr times)))))
+(define ten (quote (1 1 1 1 1 1 1 1 1 1)))
+(define l (grow (quote (1)) ten))
+(define step
+  (lambda (x)
+    (let ((y (if (null? x) (quote ()) x)))
+      ((lambda (z) (+ z 1)) (car (quote (1)))))))
+(define len
+  (lambda (list n)
+    (if (null? list)
+        n
+        (let ((m (step list)))
+          (len (cdr list) (+ n m))))))
+(define run (lambda (x) (len l 0)))
+(define runs
+  (lambda (k)
+    (if (null? k)
+        (quote done)
+        (let ((result (run k)))
+          (runs (cdr k))))))
+(runs l)
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Usage: bench/dispatch.sh INTERPRETER...
+# Times the call-heavy dispatch benchmark with each interpreter, on the
+# syntax-tree engine that eval runs. Give builds from before and after a
+# change to eval to compare the two. Build the interpreters with -O2:
+#   gcc -std=c11 -O2 *.c -o interpreter -pthread
+[ $# -gt 0 ] || { echo "usage: $0 INTERPRETER..."; exit 1; }
+dir=$(dirname "$0")
+for bin in "$@"; do
+    start=$(date +%s%N)
+    "$bin" "$dir/dispatch.scm" > /dev/null
+    echo "$bin: $(( ($(date +%s%N) - start) / 1000000 )) ms"
+done
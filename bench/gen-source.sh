@@ -0,0 +1,15 @@
+#!/bin/sh
+# Usage: bench/gen-source.sh MEGABYTES > FILE
+# Writes a Scheme program of about MEGABYTES MB for the tokenizer benchmarks:
+# defines of lambdas with lets, numbers, strings, quoted lists and comments.
+# The output depends only on MEGABYTES.
+megabytes=${1:?usage: $0 MEGABYTES}
+awk -v limit=$((megabytes * 1048576)) 'BEGIN {
+    srand(1);
+    bytes = 0;
+    for (i = 0; bytes < limit; i++) {
+        line = sprintf("; function number %d\n(define f%d\n  (lambda (x y)\n    (let ((a (+ x %d)) (b \"string %d\") (c 3.25))\n      (if (null? (quote (x y z %d)))\n          (cons a (cons b (quote ())))\n          (car (cons y #t))))))\n", i, i, int(rand() * 100000), i, i);
+        printf "%s", line;
+        bytes += length(line);
+    }
+}'
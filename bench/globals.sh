@@ -0,0 +1,31 @@
+#!/bin/sh
+# Usage: bench/globals.sh INTERPRETER
+# Global lookups with 10, 1k and 100k globals. Each program defines that many
+# globals and then calls a lambda that reads the first and the last of them
+# about a million times; a second program only defines them, so its time can
+# be taken off. With the hash-table global frame both columns should grow
+# only with the number of defines, not with lookups times globals. Build the
+# interpreter with -O2:
+#   gcc -std=c11 -O2 *.c -o interpreter -pthread
+bin=${1:?usage: $0 INTERPRETER}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+for count in 10 1000 100000; do
+    awk -v n=$count -v defines="$work/defines.scm" -v lookups="$work/lookups.scm" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "(define g%d %d)\n", i, i > defines;
+            printf "(define g%d %d)\n", i, i > lookups;
+        }
+        print "(define double (lambda (list acc) (if (null? list) acc (double (cdr list) (cons 1 (cons 1 acc))))))" > lookups;
+        print "(define grow (lambda (list times) (if (null? times) list (grow (double list (quote ())) (cdr times)))))" > lookups;
+        print "(define l (grow (quote (1)) (quote (1 1 1 1 1 1 1 1 1 1))))" > lookups;
+        printf "(define read (lambda (x) (+ g0 g%d)))\n", n - 1 > lookups;
+        print "(define reads (lambda (k) (if (null? k) (quote done) (let ((result (map read l))) (reads (cdr k))))))" > lookups;
+        print "(reads l)" > lookups;
+    }'
+    for program in defines lookups; do
+        start=$(date +%s%N)
+        "$bin" "$work/$program.scm" > /dev/null
+        echo "$count globals, $program: $(( ($(date +%s%N) - start) / 1000000 )) ms"
+    done
+done
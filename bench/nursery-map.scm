@@ -0,0 +1,23 @@
+; Allocation-heavy: 1024 maps over a 1024-element list. Each map builds a
+; new list that is garbage by the time the next one starts, so almost
+; everything dies young.
+(define double
+  (lambda (list acc)
+    (if (null? list)
+        acc
+        (double (cdr list) (cons 1 (cons 1 acc))))))
+(define grow
+  (lambda (list times)
+    (if (null? times)
+        list
+        (grow (double list (quote ())) (cdr times)))))
+(define ten (quote (1 1 1 1 1 1 1 1 1 1)))
+(define l (grow (quote (1)) ten))
+(define inc (lambda (x) (+ x 1)))
+(define maps
+  (lambda (k)
+    (if (null? k)
+        (quote done)
+        (let ((result (map inc l)))
+          (maps (cdr k))))))
+(maps l)
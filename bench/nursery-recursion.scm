@@ -0,0 +1,26 @@
+; Recursion-heavy: 20 times, count a 16384-element list without tail calls.
+; Every frame of the recursion stays alive until it returns, so much of what
+; is allocated survives a minor collection and gets promoted.
+(define double
+  (lambda (list acc)
+    (if (null? list)
+        acc
+        (double (cdr list) (cons 1 (cons 1 acc))))))
+(define grow
+  (lambda (list times)
+    (if (null? times)
+        list
+        (grow (double list (quote ())) (cdr times)))))
+(define l (grow (quote (1)) (quote (1 1 1 1 1 1 1 1 1 1 1 1 1 1))))
+(define len
+  (lambda (list)
+    (if (null? list)
+        0
+        (+ 1 (len (cdr list))))))
+(define repeat
+  (lambda (k)
+    (if (null? k)
+        (quote done)
+        (let ((n (len l)))
+          (repeat (cdr k))))))
+(repeat (quote (1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1 1)))
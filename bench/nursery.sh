@@ -0,0 +1,16 @@
+#!/bin/sh
+# Usage: bench/nursery.sh INTERPRETER
+# Runs the nursery benchmarks with the generational collector (a 1 MB
+# nursery) and with plain mark-and-sweep (no nursery), printing the wall time
+# and the collector statistics of each run. Build the interpreter with -O2:
+#   gcc -std=c11 -O2 *.c -o interpreter -pthread
+bin=${1:?usage: $0 INTERPRETER}
+dir=$(dirname "$0")
+for program in map recursion; do
+    for nursery in 1048576 0; do
+        echo "nursery-$program.scm --nursery=$nursery"
+        start=$(date +%s%N)
+        "$bin" --nursery=$nursery --gc-stats "$dir/nursery-$program.scm" > /dev/null
+        echo "  $(( ($(date +%s%N) - start) / 1000000 )) ms"
+    done
+done
@@ -0,0 +1,94 @@
+// readloop.c by Leon Liang
+
+// Times the three ways the tokenizer could read its input, without any
+// tokenizing: fgetc per character, read(2) in 64 KB blocks, and mmap of the
+// whole file. Each loop counts the '(' in the file, so that the work per
+// byte is the same and cannot be optimized away.
+// Build: gcc -std=c11 -O2 bench/readloop.c -o readloop
+// Usage: readloop FILE
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Return: The time in seconds since some fixed point
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+// Helper function
+// Count with fgetc
+static size_t countFgetc(char *path){
+    FILE *file = fopen(path, "r");
+    size_t count = 0;
+    int ch;
+    while ((ch = fgetc(file)) != EOF) {
+        count += ch == '(';
+    }
+    fclose(file);
+    return count;
+}
+
+// Helper function
+// Count with read(2) in blocks
+static size_t countRead(char *path){
+    static char block[65536];
+    int fd = open(path, O_RDONLY);
+    size_t count = 0;
+    ssize_t length;
+    while ((length = read(fd, block, sizeof(block))) > 0) {
+        for (ssize_t i = 0; i < length; i++) {
+            count += block[i] == '(';
+        }
+    }
+    close(fd);
+    return count;
+}
+
+// Helper function
+// Count in the whole file mapped at once
+static size_t countMmap(char *path){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    fstat(fd, &st);
+    char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    size_t count = 0;
+    for (off_t i = 0; i < st.st_size; i++) {
+        count += text[i] == '(';
+    }
+    munmap(text, st.st_size);
+    close(fd);
+    return count;
+}
+
+int main(int argc, char **argv){
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+        return 1;
+    }
+    struct stat st;
+    if (stat(argv[1], &st) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    double megabytes = st.st_size / 1048576.0;
+    struct {
+        const char *name;
+        size_t (*count)(char *);
+    } loops[] = {{"fgetc", countFgetc}, {"read", countRead}, {"mmap", countMmap}};
+    for (size_t i = 0; i < sizeof(loops) / sizeof(loops[0]); i++) {
+        double start = now();
+        size_t count = loops[i].count(argv[1]);
+        double seconds = now() - start;
+        printf("%-6s %8.0f MB/s (%zu parentheses)\n", loops[i].name, megabytes / seconds, count);
+    }
+    return 0;
+}
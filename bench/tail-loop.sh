@@ -0,0 +1,14 @@
+#!/bin/sh
+# Usage: bench/tail-loop.sh INTERPRETER
+# Runs the ten-million-iteration tail loop on each engine, printing the count
+# and the wall time of each run. The loop must run in constant C stack on
+# all of them. Build the interpreter with -O2:
+#   gcc -std=c11 -O2 *.c -o interpreter -pthread
+bin=${1:?usage: $0 INTERPRETER}
+dir=$(dirname "$0")
+for engine in --engine=ast --engine=vm --engine=nodes --jit; do
+    echo "tail-loop.scm $engine"
+    start=$(date +%s%N)
+    "$bin" $engine "$dir/tail-loop.scm" | tail -n 1
+    echo "  $(( ($(date +%s%N) - start) / 1000000 )) ms"
+done
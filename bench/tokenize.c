@@ -0,0 +1,46 @@
+// tokenize.c by Leon Liang
+
+// Times tokenizeFile on a file, the whole tokenizer including building the
+// list of tokens.
+// Build, from the top of the repository:
+//   gcc -std=c11 -O2 -I. $(ls *.c | grep -v main.c) bench/tokenize.c -o tokenize -pthread
+// Usage: tokenize FILE
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "tokenizer.h"
+
+// Return: The time in seconds since some fixed point
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv){
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+        return 1;
+    }
+    struct stat st;
+    if (stat(argv[1], &st) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    double start = now();
+    Object *tokens = tokenizeFile(argv[1]);
+    double seconds = now() - start;
+    size_t count = 0;
+    for (Object *current = tokens; current != NULL_OBJECT; current = cdr(current)) {
+        count++;
+    }
+    printf("tokenize %8.1f MB/s (%zu tokens)\n", st.st_size / 1048576.0 / seconds, count);
+    tfree();
+    return 0;
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Usage: bench/tokenizer.sh [MEGABYTES]
+# Generates a program of MEGABYTES MB (default 50), then times the ways of
+# reading it (bench/readloop.c) and the whole tokenizer (bench/tokenize.c)
+# built from this tree. Run from the top of the repository. To compare with
+# another commit, check it out in a separate worktree and run the script
+# there on the same file.
+set -e
+megabytes=${1:-50}
+work=${TMPDIR:-/tmp}/tokenizer-bench
+mkdir -p "$work"
+bench/gen-source.sh "$megabytes" > "$work/source.scm"
+gcc -std=c11 -O2 bench/readloop.c -o "$work/readloop"
+gcc -std=c11 -O2 -I. $(ls *.c | grep -v '^main\.c$') bench/tokenize.c -o "$work/tokenize" -pthread
+"$work/readloop" "$work/source.scm"
+"$work/tokenize" "$work/source.scm"
@@ -0,0 +1,388 @@
+// bytecode.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "interpreter.h"
+#include "bytecode.h"
+#include "nodes.h"
+#include "jit.h"
+
+// The code being compiled and how many values it has on the stack at the
+// point that is being compiled.
+typedef struct Compiler {
+    Code *code;
+    size_t depth;
+} Compiler;
+
+// Helper function
+// Input array: The address of a growable array.
+// Input capacity: The address of its capacity.
+// Input size: The size of an entry.
+// Doubles the capacity of the array.
+static void grow(void *array, size_t *capacity, size_t size){
+    *capacity = *capacity == 0 ? 16 : 2 * *capacity;
+    void **data = array;
+    *data = realloc(*data, *capacity * size);
+    if (*data == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+}
+
+// Input owner: What the code is compiled from, or NULL for a top-level
+// expression.
+// Input params: The parameter list of the lambda whose body owner is, or
+// NULL_OBJECT.
+// Return: Empty code, for either engine to compile into.
+Code *codeNew(Object *owner, Object *params){
+    Code *code = calloc(1, sizeof(Code));
+    if (code == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    code->owner = owner;
+    for (Object *current = params; isCons(current); current = cdr(current)) {
+        code->paramCount++;
+    }
+    return code;
+}
+
+// Helper function
+// Input compiler: A Compiler.
+// Input word: An instruction or an operand.
+// Return: Where the word went in the code.
+static size_t emit(Compiler *compiler, uint32_t word){
+    Code *code = compiler->code;
+    if (code->length == code->wordCapacity) {
+        grow(&code->words, &code->wordCapacity, sizeof(uint32_t));
+    }
+    code->words[code->length] = word;
+    return code->length++;
+}
+
+// Helper function
+// Input compiler: A Compiler.
+// Input delta: How many values the last instruction pushed (or popped, if
+// negative).
+static void adjust(Compiler *compiler, int delta){
+    compiler->depth += delta;
+    if (compiler->depth > compiler->code->maxStack) {
+        compiler->code->maxStack = compiler->depth;
+    }
+}
+
+// Input code: Code that is being compiled.
+// Input obj: Any Object.
+// Return: The index of obj among the constants of code, which it is added to
+// unless it is there already.
+uint32_t codeConstant(Code *code, Object *obj){
+    for (size_t i = 0; i < code->constantCount; i++) {
+        if (code->constants[i] == obj) {
+            return i;
+        }
+    }
+    if (code->constantCount == code->constantCapacity) {
+        grow(&code->constants, &code->constantCapacity, sizeof(Object *));
+    }
+    code->constants[code->constantCount] = obj;
+    return code->constantCount++;
+}
+
+// Helper function
+// Emit an instruction that pushes obj
+static void compileConstant(Compiler *compiler, Object *obj){
+    emit(compiler, OP_CONST);
+    emit(compiler, codeConstant(compiler->code, obj));
+    adjust(compiler, 1);
+}
+
+// Helper function
+// Emit an instruction that reports a syntax error. It counts as pushing a
+// value, so that the code after it, which never runs, still adds up.
+static void compileError(Compiler *compiler){
+    emit(compiler, OP_ERROR);
+    adjust(compiler, 1);
+}
+
+// Helper function
+// Emit an instruction that returns the value on top of the stack
+static void compileReturn(Compiler *compiler){
+    emit(compiler, OP_RETURN);
+    adjust(compiler, -1);
+}
+
+static void compileExpr(Compiler *compiler, Object *tree, bool tail);
+static Code *compileFunction(Object *params, Object *body);
+
+// Helper function
+// Compile the expressions of a body, leaving the value of the last one. Like
+// evalBody, a body that is not a proper list fails once it gets to the end.
+static void compileSequence(Compiler *compiler, Object *body, bool tail){
+    if (!isCons(body)) {
+        compileError(compiler);
+        return;
+    }
+    while (cdr(body) != NULL_OBJECT) {
+        compileExpr(compiler, car(body), false);
+        emit(compiler, OP_POP);
+        adjust(compiler, -1);
+        body = cdr(body);
+        if (!isCons(body)) {
+            compileError(compiler);
+            return;
+        }
+    }
+    compileExpr(compiler, car(body), tail);
+}
+
+// Helper function
+// Compile an if expression, checked with checkIf
+static void compileIf(Compiler *compiler, Object *tree, bool tail){
+    if (!checkIf(tree)) {
+        compileError(compiler);
+        return;
+    }
+    Object *conditionCons = cdr(tree);
+    Object *thenCons = cdr(conditionCons);
+    Object *elseCons = cdr(thenCons);
+
+    compileExpr(compiler, car(conditionCons), false);
+    emit(compiler, OP_JUMP_IF_FALSE);
+    size_t elseJump = emit(compiler, 0);
+    adjust(compiler, -1);
+    size_t depth = compiler->depth;
+
+    compileExpr(compiler, car(thenCons), tail);
+    size_t endJump = 0;
+    if (!tail) {
+        emit(compiler, OP_JUMP);
+        endJump = emit(compiler, 0);
+    }
+
+    compiler->code->words[elseJump] = compiler->code->length;
+    compiler->depth = depth;
+    if (isCons(elseCons)) {
+        compileExpr(compiler, car(elseCons), tail);
+    }
+    else {
+        compileConstant(compiler, UNSPECIFIED_OBJECT);
+        if (tail) {
+            compileReturn(compiler);
+        }
+    }
+    if (!tail) {
+        compiler->code->words[endJump] = compiler->code->length;
+    }
+}
+
+// Helper function
+// Compile a let expression, checked with checkLet. The values are pushed in
+// order and bound by OP_LET. A let with a bad binding computes the values
+// before it, then fails, as evalLet would.
+static void compileLet(Compiler *compiler, Object *tree, bool tail){
+    int count;
+    bool valid = checkLet(tree, &count);
+    if (!valid && count == 0) {
+        compileError(compiler);
+        return;
+    }
+    Object *pairRoot = car(cdr(tree));
+    Object *current = pairRoot;
+    for (int i = 0; i < count; i++, current = cdr(current)) {
+        compileExpr(compiler, car(cdr(car(current))), false);
+    }
+    if (!valid) {
+        compileError(compiler);
+        return;
+    }
+
+    emit(compiler, OP_LET);
+    emit(compiler, codeConstant(compiler->code, pairRoot));
+    emit(compiler, count);
+    adjust(compiler, 1 - count);
+
+    // In tail position, the frame that OP_LET saved is dropped along with the
+    // rest of the call
+    Object *body = cdr(cdr(tree));
+    if (body == NULL_OBJECT) {
+        compileConstant(compiler, UNSPECIFIED_OBJECT);
+        if (tail) {
+            compileReturn(compiler);
+            return;
+        }
+    }
+    else {
+        compileSequence(compiler, body, tail);
+        if (tail) {
+            return;
+        }
+    }
+    emit(compiler, OP_END_LET);
+    adjust(compiler, -1);
+}
+
+// Helper function
+// Compile a quote expression, checked with checkQuote
+static void compileQuote(Compiler *compiler, Object *tree){
+    if (!checkQuote(tree)) {
+        compileError(compiler);
+        return;
+    }
+    compileConstant(compiler, car(cdr(tree)));
+}
+
+// Helper function
+// Compile a define expression, checked with checkDefine. Whether the symbol
+// is bound already is checked before the value is computed, as in evalDefine.
+static void compileDefine(Compiler *compiler, Object *tree){
+    if (!checkDefine(tree)) {
+        compileError(compiler);
+        return;
+    }
+    Object *symbol = car(cdr(tree));
+    uint32_t index = codeConstant(compiler->code, symbol);
+    emit(compiler, OP_DEFINE_CHECK);
+    emit(compiler, index);
+    compileExpr(compiler, car(cdr(cdr(tree))), false);
+    emit(compiler, OP_DEFINE);
+    emit(compiler, index);
+}
+
+// Helper function
+// Compile a lambda expression, checked with checkLambda. The body gets code
+// of its own.
+static void compileLambda(Compiler *compiler, Object *tree){
+    if (!checkLambda(tree)) {
+        compileError(compiler);
+        return;
+    }
+    Object *paramList = car(cdr(tree));
+    Object *bodyList = cdr(cdr(tree));
+
+    Code *code = compileFunction(paramList, bodyList);
+    Code *parent = compiler->code;
+    if (parent->lambdaCount == parent->lambdaCapacity) {
+        grow(&parent->lambdas, &parent->lambdaCapacity, sizeof(Code *));
+    }
+    parent->lambdas[parent->lambdaCount] = code;
+    emit(compiler, OP_CLOSURE);
+    emit(compiler, codeConstant(compiler->code, paramList));
+    emit(compiler, codeConstant(compiler->code, bodyList));
+    emit(compiler, parent->lambdaCount++);
+    adjust(compiler, 1);
+}
+
+// Helper function
+// Compile a function application: the function, then the arguments from left
+// to right, then the call. Like evalApplication, an improper list of
+// arguments ends at its last cons cell.
+static void compileApplication(Compiler *compiler, Object *tree, bool tail){
+    compileExpr(compiler, car(tree), false);
+    int count = 0;
+    for (Object *args = cdr(tree); isCons(args); args = cdr(args)) {
+        compileExpr(compiler, car(args), false);
+        count++;
+    }
+    emit(compiler, tail ? OP_TAIL_CALL : OP_CALL);
+    emit(compiler, count);
+    adjust(compiler, -count);
+}
+
+// Helper function
+// Input compiler: A Compiler.
+// Input tree: An expression, resolved (see resolve.h).
+// Input tail: Whether the value of tree is returned from the code. If so, the
+// code for tree ends with a return or a tail call; otherwise it leaves the
+// value of tree on the stack.
+static void compileExpr(Compiler *compiler, Object *tree, bool tail){
+    switch (typeOf(tree)) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+            compileConstant(compiler, tree);
+            break;
+        case LOCAL_TYPE:
+            emit(compiler, OP_LOCAL);
+            emit(compiler, localDepth(tree));
+            emit(compiler, localSlot(tree));
+            adjust(compiler, 1);
+            break;
+        case SYMBOL_TYPE:
+            emit(compiler, OP_LOOKUP);
+            emit(compiler, codeConstant(compiler->code, tree));
+            adjust(compiler, 1);
+            break;
+        case CONS_TYPE:
+            switch (formOf(car(tree))) {
+                case IF_FORM: compileIf(compiler, tree, tail); return;
+                case LET_FORM: compileLet(compiler, tree, tail); return;
+                case QUOTE_FORM: compileQuote(compiler, tree); break;
+                case DEFINE_FORM: compileDefine(compiler, tree); break;
+                case LAMBDA_FORM: compileLambda(compiler, tree); break;
+                case NO_FORM: compileApplication(compiler, tree, tail); return;
+            }
+            break;
+        default:
+            compileError(compiler);
+            return;
+    }
+    if (tail) {
+        compileReturn(compiler);
+    }
+}
+
+// Helper function
+// Input params: The parameter list of a lambda, already checked.
+// Input body: Its body.
+// Return: The code of the body, which the collector owns from now on.
+static Code *compileFunction(Object *params, Object *body){
+    Compiler compiler = {codeNew(body, params), 0};
+    compileSequence(&compiler, body, true);
+    gcTrackCode(compiler.code);
+    return compiler.code;
+}
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Return: Code that evaluates tree and returns its value. Syntax errors are
+// found here, once, but turned into instructions that report them when they
+// are reached, so that a program stops at the same point as with eval. The
+// code of every lambda in tree is compiled along with it and handed to the
+// collector (see gcTrackCode); the code of tree itself belongs to the caller,
+// who frees it with codeFree.
+Code *compileExpression(Object *tree){
+    Compiler compiler = {codeNew(NULL, NULL_OBJECT), 0};
+    compileExpr(&compiler, tree, true);
+    return compiler.code;
+}
+
+// Input closure: A closure.
+// Return: The code of the body of closure. A closure that was not made by the
+// virtual machine, such as one from a heap image, has its body compiled on the
+// first call.
+Code *closureCode(Closure *closure){
+    if (closure->code == NULL) {
+        closure->code = compileFunction(closure->paramNames, closure->functionCode);
+    }
+    return closure->code;
+}
+
+// Input code: Code made by compileExpression, or code whose body the collector
+// found to be garbage.
+// Frees the code. The code of the lambdas in it is freed separately.
+void codeFree(Code *code){
+    free(code->words);
+    free(code->constants);
+    free(code->lambdas);
+    jitFree(code);
+    while (code->nodes != NULL) {
+        Node *next = code->nodes->next;
+        free(code->nodes);
+        code->nodes = next;
+    }
+    free(code);
+}
@@ -0,0 +1,94 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+
+#ifndef _BYTECODE
+#define _BYTECODE
+
+// The instructions of the virtual machine (see vm.h). Each is a word of code
+// followed by its operands, one word each. The machine keeps the values it
+// works on in a stack; "k" is the index of a constant of the code.
+typedef enum {
+    OP_CONST,           // k: push constant k
+    OP_LOCAL,           // depth slot: push a local variable (see makeLocal)
+    OP_LOOKUP,          // k: push the value of the Symbol k, looked up by name
+    OP_POP,             // drop the top of the stack
+    OP_JUMP,            // target: go on at word target of the code
+    OP_JUMP_IF_FALSE,   // target: pop a value; go on at target if it is #f
+    OP_LET,             // k count: pop count values into a new frame for the
+                        // bindings k of a let; push the current frame and
+                        // make the new one current
+    OP_END_LET,         // make the frame that OP_LET pushed under the top of
+                        // the stack current again, and drop it
+    OP_DEFINE_CHECK,    // k: an error if the Symbol k is bound in the frame
+    OP_DEFINE,          // k: bind the Symbol k to the value on top of the
+                        // stack in the current frame, which becomes void
+    OP_CLOSURE,         // k k lambda: push a closure with the parameters and
+                        // body in the two constants, and lambda's code
+    OP_CALL,            // count: call the function under count arguments
+    OP_TAIL_CALL,       // count: the same, in place of the current call
+    OP_RETURN,          // return the value on top of the stack
+    OP_ERROR,           // stop with an evaluation error
+    NUM_OPS
+} opcode;
+
+// The compiled form of a top-level expression or of the body of a lambda:
+// bytecode, or a tree of nodes (see nodes.h), depending on the engine. Its
+// constants are Objects from the expression, such as quoted lists and the
+// Symbols that are looked up by name; the collector must keep them alive and
+// up to date for as long as the code may run (see gcTrackCode).
+typedef struct Code {
+    Object *owner;              // the body the code was compiled from
+    uint32_t *words;
+    size_t length;
+    size_t wordCapacity;
+    Object **constants;
+    size_t constantCount;
+    size_t constantCapacity;
+    struct Code **lambdas;      // the code of the lambdas in the expression
+    size_t lambdaCount;
+    size_t lambdaCapacity;
+    size_t maxStack;            // the most values the code ever has on the stack
+    int paramCount;
+    struct Node *node;          // the root of the tree of nodes
+    struct Node *nodes;         // all the nodes of the tree, for codeFree
+    uint32_t calls;             // how often the tree ran, up to the threshold
+                                // of the JIT (see jit.h)
+    void *native;               // the tree compiled to machine code, or NULL
+    size_t nativeSize;
+} Code;
+
+// Input owner: What the code is compiled from, or NULL for a top-level
+// expression.
+// Input params: The parameter list of the lambda whose body owner is, or
+// NULL_OBJECT.
+// Return: Empty code, for either engine to compile into.
+Code *codeNew(Object *owner, Object *params);
+
+// Input code: Code that is being compiled.
+// Input obj: Any Object.
+// Return: The index of obj among the constants of code, which it is added to
+// unless it is there already.
+uint32_t codeConstant(Code *code, Object *obj);
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Return: Code that evaluates tree and returns its value. Syntax errors are
+// found here, once, but turned into instructions that report them when they
+// are reached, so that a program stops at the same point as with eval. The
+// code of every lambda in tree is compiled along with it and handed to the
+// collector (see gcTrackCode); the code of tree itself belongs to the caller,
+// who frees it with codeFree.
+Code *compileExpression(Object *tree);
+
+// Input closure: A closure.
+// Return: The code of the body of closure. A closure that was not made by the
+// virtual machine, such as one from a heap image, has its body compiled on the
+// first call.
+Code *closureCode(Closure *closure);
+
+// Input code: Code made by compileExpression, or code whose body the collector
+// found to be garbage.
+// Frees the code. The code of the lambdas in it is freed separately.
+void codeFree(Code *code);
+
+#endif
@@ -0,0 +1,635 @@
+// cache.c by Leon Liang
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "symbol.h"
+#include "parallel.h"
+#include "tokenizer.h"
+#include "cache.h"
+
+// A cache file is a CacheHeader followed by three sections:
+//   symbols: the name of every distinct symbol in the tree, each a number
+//            (its length) and its characters; a symbol node refers to its
+//            name by position
+//   strings: the characters of every string literal, in the order the
+//            literals appear in the tree, each a number and its characters
+//   nodes:   the tree in prefix order, each node a NODE_* byte followed by
+//            its operands; a list is NODE_LIST, the number of items and the
+//            items; the forest itself is the number of top-level
+//            expressions followed by them
+// Numbers are unsigned LEB128: seven bits per byte, low bits first, with the
+// high bit set on every byte but the last. Integers are zigzag encoded first
+// and doubles are their 8 bytes in the machine's order. The magic changes
+// with the layout, so old or foreign files are simply not used, and the
+// sections are hashed as well, so damaged files are not used either.
+#define CACHE_MAGIC "SCMAST3"
+#define CACHE_SUFFIX ".ast"
+
+enum {
+    NODE_NULL,
+    NODE_TRUE,
+    NODE_FALSE,
+    NODE_INT,
+    NODE_DOUBLE,
+    NODE_STRING,
+    NODE_SYMBOL,
+    NODE_LIST
+};
+
+typedef struct CacheHeader {
+    char magic[8];
+    uint64_t hash[2];           // of the program's contents
+    uint64_t sourceLength;      // of the program's contents
+    uint64_t symbolCount;
+    uint64_t symbolBytes;       // size of the symbols section
+    uint64_t stringBytes;       // size of the strings section
+    uint64_t nodeBytes;         // size of the nodes section
+    uint64_t dataHash[2];       // of the three sections
+} CacheHeader;
+
+// A 128-bit hash (see hashBytes).
+typedef struct Digest {
+    uint64_t low;
+    uint64_t high;
+} Digest;
+
+#define PRIME1 11400714785074694791u
+#define PRIME2 14029467366897019727u
+#define PRIME3 1609587929392839161u
+#define PRIME4 9650029242287828579u
+#define PRIME5 2870177450012600261u
+
+// Helper function
+// Return x rotated left by bits, 0 < bits < 64
+static inline uint64_t rotate(uint64_t x, int bits){
+    return x << bits | x >> (64 - bits);
+}
+
+// Helper function
+// Mix one word of input into a lane
+static inline uint64_t mixWord(uint64_t lane, uint64_t word){
+    return rotate(lane + word * PRIME2, 31) * PRIME1;
+}
+
+// Helper function
+// Spread every bit of hash over all the bits of the result
+static uint64_t avalanche(uint64_t hash){
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Helper function
+// Input data: The bytes to hash, such as the characters of a program.
+// Input length: The number of bytes.
+// Input seed: The hash of whatever came before data, or {0, 0}.
+// Return: A 128-bit hash of data. Data is read eight bytes at a time into four
+// independent lanes, as in xxHash64, so that hashing a large program takes a
+// small fraction of the time that parsing it would. Each step rotates as well
+// as multiplies, so that every bit of the input reaches every bit of the
+// lane, and the two halves of the result combine the lanes in different
+// orders before a final avalanche. A cache file is trusted whenever the hash
+// matches, so a change to the program must not leave it the same.
+static Digest hashBytes(const void *data, size_t length, Digest seed){
+    const unsigned char *text = data;
+    uint64_t lanes[4] = {seed.low + PRIME1 + PRIME2, seed.low + PRIME2,
+                         seed.high, seed.high - PRIME1};
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, text + i + 8 * lane, 8);
+            lanes[lane] = mixWord(lanes[lane], word);
+        }
+    }
+    uint64_t low = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12)
+            + rotate(lanes[3], 18);
+    uint64_t high = rotate(lanes[3], 1) + rotate(lanes[2], 7) + rotate(lanes[1], 12)
+            + rotate(lanes[0], 18);
+    for (int lane = 0; lane < 4; lane++) {
+        low = (low ^ mixWord(0, lanes[lane])) * PRIME1 + PRIME4;
+        high = (high ^ mixWord(0, lanes[3 - lane])) * PRIME1 + PRIME4;
+    }
+    low += length;
+    high += length ^ PRIME3;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        low = rotate(low ^ mixWord(0, word), 27) * PRIME1 + PRIME4;
+        high = rotate(high ^ mixWord(PRIME5, word), 29) * PRIME2 + PRIME3;
+    }
+    for (; i < length; i++) {
+        low = rotate(low ^ text[i] * PRIME5, 11) * PRIME1;
+        high = rotate(high ^ text[i] * PRIME3, 13) * PRIME2;
+    }
+    Digest digest = {avalanche(low), avalanche(high ^ rotate(low, 32))};
+    return digest;
+}
+
+// Helper function
+// Input header: The header of a cache file, with the section sizes filled in.
+// Input symbols: The symbols section.
+// Input strings: The strings section.
+// Input nodes: The nodes section.
+// Return: The hash of the three sections.
+static Digest hashSections(CacheHeader *header, const void *symbols, const void *strings,
+                           const void *nodes){
+    Digest hash = {0, 0};
+    hash = hashBytes(symbols, header->symbolBytes, hash);
+    hash = hashBytes(strings, header->stringBytes, hash);
+    return hashBytes(nodes, header->nodeBytes, hash);
+}
+
+// A growing array of bytes on the C heap.
+typedef struct Bytes {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} Bytes;
+
+// Helper function
+// Input bytes: A Bytes.
+// Input data: The bytes to append.
+// Input count: The number of bytes to append.
+static void putBytes(Bytes *bytes, const void *data, size_t count){
+    if (bytes->length + count > bytes->capacity) {
+        size_t capacity = bytes->capacity == 0 ? 4096 : bytes->capacity * 2;
+        while (capacity < bytes->length + count) {
+            capacity *= 2;
+        }
+        bytes->data = realloc(bytes->data, capacity);
+        if (bytes->data == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+        bytes->capacity = capacity;
+    }
+    memcpy(bytes->data + bytes->length, data, count);
+    bytes->length += count;
+}
+
+// Helper function
+// Input bytes: A Bytes.
+// Input number: The number to append in LEB128.
+static void putNumber(Bytes *bytes, uint64_t number){
+    unsigned char buffer[10];
+    size_t count = 0;
+    while (number >= 0x80) {
+        buffer[count++] = (unsigned char)(number | 0x80);
+        number >>= 7;
+    }
+    buffer[count++] = (unsigned char)number;
+    putBytes(bytes, buffer, count);
+}
+
+// Helper function
+// Input bytes: A Bytes.
+// Input tag: The NODE_* byte to append.
+static void putTag(Bytes *bytes, int tag){
+    unsigned char byte = (unsigned char)tag;
+    putBytes(bytes, &byte, 1);
+}
+
+// The sections of a cache file while it is being written, and the position of
+// every symbol written so far, in an open-addressing table keyed by pointer.
+typedef struct Writer {
+    Bytes symbols;
+    Bytes strings;
+    Bytes nodes;
+    Symbol **keys;              // NULL if the slot is empty
+    uint64_t *positions;
+    size_t capacity;
+    size_t symbolCount;
+} Writer;
+
+// Helper function
+// Input writer: A Writer.
+// Input symbol: A symbol in the tree being written.
+// Return: The position of symbol in the symbols section. The first time a
+// symbol is seen, its name is appended to the section.
+static uint64_t symbolPosition(Writer *writer, Symbol *symbol){
+    if (2 * (writer->symbolCount + 1) > writer->capacity) {
+        size_t capacity = writer->capacity == 0 ? 1024 : writer->capacity * 2;
+        Symbol **keys = calloc(capacity, sizeof(Symbol *));
+        uint64_t *positions = malloc(capacity * sizeof(uint64_t));
+        if (keys == NULL || positions == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+        for (size_t i = 0; i < writer->capacity; i++) {
+            if (writer->keys[i] != NULL) {
+                size_t slot = ((uintptr_t)writer->keys[i] >> 4) & (capacity - 1);
+                while (keys[slot] != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                keys[slot] = writer->keys[i];
+                positions[slot] = writer->positions[i];
+            }
+        }
+        free(writer->keys);
+        free(writer->positions);
+        writer->keys = keys;
+        writer->positions = positions;
+        writer->capacity = capacity;
+    }
+
+    size_t slot = ((uintptr_t)symbol >> 4) & (writer->capacity - 1);
+    while (writer->keys[slot] != NULL) {
+        if (writer->keys[slot] == symbol) {
+            return writer->positions[slot];
+        }
+        slot = (slot + 1) & (writer->capacity - 1);
+    }
+    size_t length = strlen(symbol->value);
+    putNumber(&writer->symbols, length);
+    putBytes(&writer->symbols, symbol->value, length);
+    writer->keys[slot] = symbol;
+    writer->positions[slot] = writer->symbolCount;
+    return writer->symbolCount++;
+}
+
+// Helper function
+// Input writer: A Writer.
+// Input obj: A token or list of the tree being written.
+// Return: True if obj was written, false if it is something a parsed program
+// cannot contain.
+static bool writeObject(Writer *writer, Object *obj){
+    switch (typeOf(obj)) {
+        case NULL_TYPE:
+            putTag(&writer->nodes, NODE_NULL);
+            return true;
+        case BOOL_TYPE:
+            putTag(&writer->nodes, boolValue(obj) ? NODE_TRUE : NODE_FALSE);
+            return true;
+        case INT_TYPE: {
+            int64_t value = intValue(obj);
+            putTag(&writer->nodes, NODE_INT);
+            putNumber(&writer->nodes, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+            return true;
+        }
+        case DOUBLE_TYPE:
+            putTag(&writer->nodes, NODE_DOUBLE);
+            putBytes(&writer->nodes, &((Double *)obj)->value, sizeof(double));
+            return true;
+        case STR_TYPE: {
+            size_t length = strlen(((String *)obj)->value);
+            putTag(&writer->nodes, NODE_STRING);
+            putNumber(&writer->strings, length);
+            putBytes(&writer->strings, ((String *)obj)->value, length);
+            return true;
+        }
+        case SYMBOL_TYPE: {
+            uint64_t position = symbolPosition(writer, (Symbol *)obj);
+            putTag(&writer->nodes, NODE_SYMBOL);
+            putNumber(&writer->nodes, position);
+            return true;
+        }
+        case CONS_TYPE:
+            putTag(&writer->nodes, NODE_LIST);
+            putNumber(&writer->nodes, length(obj));
+            for (; obj != NULL_OBJECT; obj = cdr(obj)) {
+                if (!writeObject(writer, car(obj))) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Helper function
+// Input cachePath: Where to save the cache file.
+// Input header: The header, with the source's hash and length filled in.
+// Input tree: The forest parsed from the source.
+// Saves tree to cachePath. The file is written under a temporary name and
+// then renamed, so that a run that loads it never sees half a file. Failing
+// to save is not an error; the next run just parses again.
+static void writeCache(char *cachePath, CacheHeader *header, Object *tree){
+    Writer writer;
+    memset(&writer, 0, sizeof(Writer));
+    putNumber(&writer.nodes, length(tree));
+    bool ok = true;
+    for (Object *form = tree; ok && form != NULL_OBJECT; form = cdr(form)) {
+        ok = writeObject(&writer, car(form));
+    }
+
+    size_t tempLength = strlen(cachePath) + 32;
+    char *tempPath = malloc(tempLength);
+    int fd = -1;
+    if (ok && tempPath != NULL) {
+        snprintf(tempPath, tempLength, "%s.%ld.tmp", cachePath, (long)getpid());
+        fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd >= 0) {
+        header->symbolCount = writer.symbolCount;
+        header->symbolBytes = writer.symbols.length;
+        header->stringBytes = writer.strings.length;
+        header->nodeBytes = writer.nodes.length;
+        Digest dataHash = hashSections(header, writer.symbols.data, writer.strings.data,
+                                       writer.nodes.data);
+        header->dataHash[0] = dataHash.low;
+        header->dataHash[1] = dataHash.high;
+        ok = writeAll(fd, header, sizeof(CacheHeader))
+                && writeAll(fd, writer.symbols.data, writer.symbols.length)
+                && writeAll(fd, writer.strings.data, writer.strings.length)
+                && writeAll(fd, writer.nodes.data, writer.nodes.length);
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(tempPath, cachePath) != 0) {
+            unlink(tempPath);
+        }
+    }
+    free(tempPath);
+    free(writer.symbols.data);
+    free(writer.strings.data);
+    free(writer.nodes.data);
+    free(writer.keys);
+    free(writer.positions);
+}
+
+// The part of a section that has not been read yet.
+typedef struct Input {
+    const unsigned char *ptr;
+    const unsigned char *end;
+    bool failed;                // whether a read went past the end
+} Input;
+
+// Helper function
+// Input input: An Input.
+// Return: The next byte of input, or 0 if there is none.
+static inline unsigned char readByte(Input *input){
+    if (input->ptr == input->end) {
+        input->failed = true;
+        return 0;
+    }
+    return *input->ptr++;
+}
+
+// Helper function
+// Input input: An Input.
+// Return: The next LEB128 number of input, or 0 if it runs past the end.
+static inline uint64_t readNumber(Input *input){
+    uint64_t number = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = readByte(input);
+        number |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return number;
+        }
+    }
+    input->failed = true;
+    return 0;
+}
+
+// Helper function
+// Input input: An Input that starts with a length.
+// Input length: Where to store the length.
+// Return: The characters that follow the length, which are skipped, or NULL
+// if there are fewer than that.
+static const char *readChars(Input *input, size_t *length){
+    *length = readNumber(input);
+    if (input->failed || *length > (size_t)(input->end - input->ptr)) {
+        input->failed = true;
+        return NULL;
+    }
+    const char *chars = (const char *)input->ptr;
+    input->ptr += *length;
+    return chars;
+}
+
+// A list that is still being read: its first and last cell, and how many of
+// its items are still to come.
+typedef struct ReadLevel {
+    Object *head;
+    Object *tail;
+    uint64_t remaining;
+} ReadLevel;
+
+// Helper function
+// Input header: The header of a cache file.
+// Input data: The sections that follow the header.
+// Input tree: Where to store the forest.
+// Return: True if the sections hold a whole forest, which is then in tree.
+// The tree is built in one pass over the nodes, without recursion, and every
+// symbol is interned just once. Nothing is trusted: if the file turns out to
+// be damaged, false is returned and the program should be parsed instead.
+static bool readCache(CacheHeader *header, const unsigned char *data, Object **tree){
+    Input symbols = {data, data + header->symbolBytes, false};
+    Input strings = {symbols.end, symbols.end + header->stringBytes, false};
+    Input nodes = {strings.end, strings.end + header->nodeBytes, false};
+
+    Symbol **table = malloc((header->symbolCount + 1) * sizeof(Symbol *));
+    int capacity = 64;
+    ReadLevel *levels = malloc(capacity * sizeof(ReadLevel));
+    if (table == NULL || levels == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    for (uint64_t i = 0; i < header->symbolCount && !symbols.failed; i++) {
+        size_t length;
+        const char *name = readChars(&symbols, &length);
+        table[i] = symbols.failed ? NULL : intern(name, length);
+    }
+
+    int depth = 1;
+    levels[0] = (ReadLevel){NULL_OBJECT, NULL_OBJECT, readNumber(&nodes)};
+    bool ok = !symbols.failed && symbols.ptr == symbols.end;
+    while (ok && depth > 0) {
+        ReadLevel *level = &levels[depth - 1];
+        Object *item;
+        if (level->remaining == 0) {
+            // The list is complete and becomes an item of the one around it
+            item = level->head;
+            depth--;
+            if (depth == 0) {
+                *tree = item;
+                break;
+            }
+            level = &levels[depth - 1];
+        }
+        else {
+            level->remaining--;
+            switch (readByte(&nodes)) {
+                case NODE_NULL:
+                    item = NULL_OBJECT;
+                    break;
+                case NODE_TRUE:
+                    item = TRUE_OBJECT;
+                    break;
+                case NODE_FALSE:
+                    item = FALSE_OBJECT;
+                    break;
+                case NODE_INT: {
+                    uint64_t zigzag = readNumber(&nodes);
+                    item = makeInteger((int)(int64_t)((zigzag >> 1) ^ -(zigzag & 1)));
+                    break;
+                }
+                case NODE_DOUBLE: {
+                    if (nodes.end - nodes.ptr < (ptrdiff_t)sizeof(double)) {
+                        ok = false;
+                        continue;
+                    }
+                    Double *doubleObj = (Double *)tallocPool(DOUBLE_POOL);
+                    doubleObj->type = DOUBLE_TYPE;
+                    memcpy(&doubleObj->value, nodes.ptr, sizeof(double));
+                    nodes.ptr += sizeof(double);
+                    item = (Object *)doubleObj;
+                    break;
+                }
+                case NODE_STRING: {
+                    size_t length;
+                    const char *chars = readChars(&strings, &length);
+                    if (chars == NULL) {
+                        ok = false;
+                        continue;
+                    }
+                    String *strObj = (String *)tallocObject(STR_TYPE, sizeof(String));
+                    strObj->type = STR_TYPE;
+                    strObj->value = talloc(length + 1);
+                    memcpy(strObj->value, chars, length);
+                    strObj->value[length] = '\0';
+                    item = (Object *)strObj;
+                    break;
+                }
+                case NODE_SYMBOL: {
+                    uint64_t position = readNumber(&nodes);
+                    if (position >= header->symbolCount) {
+                        ok = false;
+                        continue;
+                    }
+                    item = (Object *)table[position];
+                    break;
+                }
+                case NODE_LIST: {
+                    uint64_t count = readNumber(&nodes);
+                    if (count == 0 || count > (uint64_t)(nodes.end - nodes.ptr)) {
+                        ok = false;
+                        continue;
+                    }
+                    if (depth == capacity) {
+                        capacity *= 2;
+                        levels = realloc(levels, capacity * sizeof(ReadLevel));
+                        if (levels == NULL) {
+                            printf("Evaluation error: out of memory\n");
+                            texit(1);
+                        }
+                    }
+                    levels[depth++] = (ReadLevel){NULL_OBJECT, NULL_OBJECT, count};
+                    continue;
+                }
+                default:
+                    ok = false;
+                    continue;
+            }
+        }
+
+        // Append the item to the list being read
+        Object *cell = cons(item, NULL_OBJECT);
+        if (level->head == NULL_OBJECT) {
+            level->head = cell;
+        }
+        else {
+            consCell(level->tail)->cdr = cell;
+        }
+        level->tail = cell;
+    }
+    ok = ok && !nodes.failed && nodes.ptr == nodes.end
+            && !strings.failed && strings.ptr == strings.end;
+    free(table);
+    free(levels);
+    return ok;
+}
+
+// Helper function
+// Input cachePath: Where the cache file would be.
+// Input hash: The hash of the program's contents.
+// Input length: The length of the program's contents.
+// Input tree: Where to store the forest.
+// Return: True if there is a cache file for exactly these contents, which is
+// then loaded into tree.
+static bool loadCache(char *cachePath, Digest hash, size_t length, Object **tree){
+    int fd = open(cachePath, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CacheHeader)) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            CacheHeader header;
+            memcpy(&header, map, sizeof(CacheHeader));
+            uint64_t size = st.st_size - sizeof(CacheHeader);
+            ok = memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0
+                    && header.hash[0] == hash.low && header.hash[1] == hash.high
+                    && header.sourceLength == length
+                    && header.symbolBytes <= size
+                    && header.stringBytes <= size - header.symbolBytes
+                    && header.nodeBytes == size - header.symbolBytes - header.stringBytes
+                    && header.symbolCount <= header.symbolBytes;
+            unsigned char *data = (unsigned char *)map + sizeof(CacheHeader);
+            Digest dataHash = {0, 0};
+            if (ok) {
+                dataHash = hashSections(&header, data, data + header.symbolBytes,
+                                        data + header.symbolBytes + header.stringBytes);
+            }
+            ok = ok && header.dataHash[0] == dataHash.low && header.dataHash[1] == dataHash.high
+                    && readCache(&header, data, tree);
+            munmap(map, st.st_size);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+// Input path: The path of a file with a Scheme program.
+// Input text: The characters of that program, as read by readSource.
+// Input length: The number of characters in text.
+// Input threads: How many threads may parse the program if it is not cached
+// (see parseParallel).
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// of the program, just like parseAll. The tree is saved in a binary file next
+// to the program, path with ".ast" appended, and later runs load it from there
+// instead of parsing the program again, for as long as the program's contents
+// stay the same. If a syntax error is encountered, then an error message is
+// printed and the program cleanly exits.
+Object *parseCached(char *path, const char *text, size_t length, int threads){
+    char *cachePath = malloc(strlen(path) + sizeof(CACHE_SUFFIX));
+    if (cachePath == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    strcpy(cachePath, path);
+    strcat(cachePath, CACHE_SUFFIX);
+
+    Digest noSeed = {0, 0};
+    Digest hash = hashBytes(text, length, noSeed);
+    Object *tree;
+    if (!loadCache(cachePath, hash, length, &tree)) {
+        tree = parseParallel(text, length, threads);
+        CacheHeader header;
+        memset(&header, 0, sizeof(CacheHeader));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.hash[0] = hash.low;
+        header.hash[1] = hash.high;
+        header.sourceLength = length;
+        writeCache(cachePath, &header, tree);
+    }
+    free(cachePath);
+    return tree;
+}
@@ -0,0 +1,20 @@
+#include <stddef.h>
+#include "object.h"
+
+#ifndef _CACHE
+#define _CACHE
+
+// Input path: The path of a file with a Scheme program.
+// Input text: The characters of that program, as read by readSource.
+// Input length: The number of characters in text.
+// Input threads: How many threads may parse the program if it is not cached
+// (see parseParallel).
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// of the program, just like parseAll. The tree is saved in a binary file next
+// to the program, path with ".ast" appended, and later runs load it from there
+// instead of parsing the program again, for as long as the program's contents
+// stay the same. If a syntax error is encountered, then an error message is
+// printed and the program cleanly exits.
+Object *parseCached(char *path, const char *text, size_t length, int threads);
+
+#endif
@@ -0,0 +1,217 @@
+// frame.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "frame.h"
+
+// A lookup that passes this many bindings of a frame gives the frame a table.
+// Below that, walking the list is as fast as hashing.
+#define FRAME_TABLE_MIN 8
+
+// Input parent: The frame the new frame is nested in, or NULL for a global
+// frame.
+// Input names: The parameter list of a lambda, or the list of bindings of a
+// let, that the slots of the frame are for. NULL_OBJECT for a global frame.
+// Input count: The number of entries in names.
+// Return: A new frame without any bindings, with room for the values of the
+// first FRAME_SLOTS_MAX names in its slots (see frameAddSlot).
+Frame *makeFrame(Frame *parent, Object *names, int count){
+    int capacity = count < FRAME_SLOTS_MAX ? count : FRAME_SLOTS_MAX;
+    Frame *frame = tallocPool(tpoolForFrame(capacity));
+    frame->type = FRAME_TYPE;
+    frame->count = 0;
+    frame->capacity = capacity;
+    frame->parent = parent;
+    frame->bindings = NULL_OBJECT;
+    frame->table = NULL;
+    frame->names = names;
+    return frame;
+}
+
+// Input frame: A frame made by makeFrame.
+// Input symbol: The next name in the names of the frame.
+// Input value: Its value.
+// Fills the next slot of frame with value. Once the slots are full, symbol is
+// bound with frameBind instead, and can only be found by name.
+void frameAddSlot(Frame *frame, Object *symbol, Object *value){
+    if (frame->count < frame->capacity) {
+        frame->slots[frame->count++] = value;
+        gcWriteBarrier(frame, value);
+    }
+    else {
+        frameBind(frame, symbol, value);
+    }
+}
+
+// Helper function
+// Input table: A FrameTable.
+// Input symbol: A Symbol.
+// Return: The slot of symbol in table, or the empty slot where it would go.
+static FrameEntry *findEntry(FrameTable *table, Object *symbol){
+    size_t mask = table->capacity - 1;
+    size_t slot = (((uintptr_t)symbol >> 3) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+    while (table->entries[slot].symbol != NULL && table->entries[slot].symbol != symbol) {
+        slot = (slot + 1) & mask;
+    }
+    return &table->entries[slot];
+}
+
+// Helper function
+// Input table: A FrameTable.
+// Input capacity: The number of slots, a power of two.
+// Gives table that many empty slots.
+static void newEntries(FrameTable *table, size_t capacity){
+    table->entries = calloc(capacity, sizeof(FrameEntry));
+    if (table->entries == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    table->capacity = capacity;
+    table->count = 0;
+}
+
+// Helper function
+// Input frame: A frame that has a table.
+// Input binding: A binding to add to it.
+// Input replace: Whether binding should replace an existing binding of the
+// same symbol, rather than be dropped.
+static void addEntry(Frame *frame, Object *binding, bool replace){
+    FrameTable *table = frame->table;
+    if (2 * (table->count + 1) > table->capacity) {
+        FrameEntry *entries = table->entries;
+        size_t capacity = table->capacity;
+        size_t count = table->count;
+        newEntries(table, 2 * capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            if (entries[i].symbol != NULL) {
+                *findEntry(table, entries[i].symbol) = entries[i];
+            }
+        }
+        table->count = count;
+        free(entries);
+    }
+    Object *symbol = consCell(binding)->car;
+    FrameEntry *entry = findEntry(table, symbol);
+    if (entry->symbol == NULL) {
+        entry->symbol = symbol;
+        entry->binding = binding;
+        table->count++;
+    }
+    else if (replace) {
+        entry->binding = binding;
+    }
+    else {
+        return;
+    }
+    // The table is part of the frame as far as the collector is concerned
+    gcWriteBarrier(frame, binding);
+}
+
+// Helper function
+// Input frame: A frame without a table.
+// Gives frame a table of all of its bindings. Where a symbol is bound more
+// than once, the newest binding is the one that counts, as in the list.
+static void indexFrame(Frame *frame){
+    size_t count = 0;
+    for (Object *current = frame->bindings; current != NULL_OBJECT; current = consCell(current)->cdr) {
+        count++;
+    }
+    size_t capacity = 4 * FRAME_TABLE_MIN;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    frame->table = malloc(sizeof(FrameTable));
+    if (frame->table == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    frame->table->frame = frame;
+    newEntries(frame->table, capacity);
+    for (Object *current = frame->bindings; current != NULL_OBJECT; current = consCell(current)->cdr) {
+        addEntry(frame, consCell(current)->car, false);
+    }
+    gcTrackTable(frame->table);
+}
+
+// Input frame: A frame.
+// Input symbol: A Symbol.
+// Input value: The value to bind it to.
+// Binds symbol to value in frame. An existing binding of symbol in frame is
+// shadowed, not checked for; callers that must reject it look it up first.
+void frameBind(Frame *frame, Object *symbol, Object *value){
+    Object *binding = cons(symbol, value);
+    frame->bindings = cons(binding, frame->bindings);
+    gcWriteBarrier(frame, frame->bindings);
+    if (frame->table != NULL) {
+        addEntry(frame, binding, true);
+    }
+}
+
+// Input frame: A frame.
+// Input symbol: A Symbol.
+// Return: Where the value of symbol is kept in frame itself, not in its
+// parents: a slot of the frame, or the cdr of a binding. NULL if symbol is not
+// bound in frame. The filled slots are searched first, by the names they are
+// for. Small lists of bindings are searched from the newest binding to the
+// oldest. Once a lookup has to pass more than a few bindings, the frame gets a
+// hash table of them, keyed by Symbol, so that finding a global takes the same
+// time no matter how many globals there are.
+Object **frameLookup(Frame *frame, Object *symbol){
+    Object *names = frame->names;
+    for (int i = 0; i < frame->count; i++) {
+        Object *name = consCell(names)->car;
+        if (isCons(name)) {
+            name = consCell(name)->car; // a let binding (name value)
+        }
+        if (name == symbol) {
+            return &frame->slots[i];
+        }
+        names = consCell(names)->cdr;
+    }
+
+    Object *binding = NULL;
+    if (frame->table == NULL) {
+        int passed = 0;
+        for (Object *current = frame->bindings; current != NULL_OBJECT; current = consCell(current)->cdr) {
+            if (consCell(consCell(current)->car)->car == symbol) {
+                binding = consCell(current)->car;
+                break;
+            }
+            if (++passed == FRAME_TABLE_MIN) {
+                indexFrame(frame);
+                break;
+            }
+        }
+    }
+    if (frame->table != NULL) {
+        FrameEntry *entry = findEntry(frame->table, symbol);
+        binding = entry->symbol == NULL ? NULL : entry->binding;
+    }
+    return binding == NULL ? NULL : &consCell(binding)->cdr;
+}
+
+// Input frame: A frame that has a table.
+// Input update: A function that returns where an object lives now.
+// Replaces every binding in the table by update of it. Used by the collector
+// when it moves young bindings out of the nursery.
+void frameUpdateTable(Frame *frame, Object *(*update)(Object *)){
+    FrameTable *table = frame->table;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].symbol != NULL) {
+            table->entries[i].binding = update(table->entries[i].binding);
+        }
+    }
+}
+
+// Input table: The table of a frame that is garbage.
+// Frees the table. The collector calls this; the frame itself is reclaimed
+// like any other object.
+void frameFreeTable(FrameTable *table){
+    free(table->entries);
+    free(table);
+}
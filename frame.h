@@ -0,0 +1,68 @@
+#include "object.h"
+
+#ifndef _FRAME
+#define _FRAME
+
+// The bindings of a frame in an open-addressing hash table with linear
+// probing, keyed by the address of the Symbol. Symbols are interned and never
+// move, so the address is all a key needs. The table is kept at most half
+// full. Its memory comes from malloc, since it is freed as soon as the
+// collector finds its frame to be garbage (see gcTrackTable).
+typedef struct FrameEntry {
+    Object *symbol;         // NULL if the slot is empty
+    Object *binding;
+} FrameEntry;
+
+typedef struct FrameTable {
+    Frame *frame;           // the frame whose bindings these are
+    FrameEntry *entries;
+    size_t capacity;        // a power of two
+    size_t count;
+} FrameTable;
+
+// Input parent: The frame the new frame is nested in, or NULL for a global
+// frame.
+// Input names: The parameter list of a lambda, or the list of bindings of a
+// let, that the slots of the frame are for. NULL_OBJECT for a global frame.
+// Input count: The number of entries in names.
+// Return: A new frame without any bindings, with room for the values of the
+// first FRAME_SLOTS_MAX names in its slots (see frameAddSlot).
+Frame *makeFrame(Frame *parent, Object *names, int count);
+
+// Input frame: A frame made by makeFrame.
+// Input symbol: The next name in the names of the frame.
+// Input value: Its value.
+// Fills the next slot of frame with value. Once the slots are full, symbol is
+// bound with frameBind instead, and can only be found by name.
+void frameAddSlot(Frame *frame, Object *symbol, Object *value);
+
+// Input frame: A frame.
+// Input symbol: A Symbol.
+// Input value: The value to bind it to.
+// Binds symbol to value in frame. An existing binding of symbol in frame is
+// shadowed, not checked for; callers that must reject it look it up first.
+void frameBind(Frame *frame, Object *symbol, Object *value);
+
+// Input frame: A frame.
+// Input symbol: A Symbol.
+// Return: Where the value of symbol is kept in frame itself, not in its
+// parents: a slot of the frame, or the cdr of a binding. NULL if symbol is not
+// bound in frame. The filled slots are searched first, by the names they are
+// for. Small lists of bindings are searched from the newest binding to the
+// oldest. Once a lookup has to pass more than a few bindings, the frame gets a
+// hash table of them, keyed by Symbol, so that finding a global takes the same
+// time no matter how many globals there are.
+Object **frameLookup(Frame *frame, Object *symbol);
+
+// Input frame: A frame that has a table.
+// Input update: A function that returns where an object lives now.
+// Replaces every binding in the table by update of it. Used by the collector
+// when it moves young bindings out of the nursery.
+void frameUpdateTable(Frame *frame, Object *(*update)(Object *));
+
+// Input table: The table of a frame that is garbage.
+// Frees the table. The collector calls this; the frame itself is reclaimed
+// like any other object.
+void frameFreeTable(FrameTable *table);
+
+#endif
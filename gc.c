@@ -0,0 +1,559 @@
+// gc.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "object.h"
+#include "talloc.h"
+#include "gc.h"
+#include "frame.h"
+#include "bytecode.h"
+
+// Default thresholds: collect the old generation once 4 MB of pooled objects
+// are live, and after that whenever it has doubled since the last collection.
+#define GC_MIN_HEAP (4 * 1024 * 1024)
+#define GC_GROWTH_PERCENT 200
+
+// Default nursery size. Young objects that survive a minor collection are
+// promoted straight into the pools of the old generation.
+#define GC_NURSERY_SIZE (1024 * 1024)
+
+static size_t heapMinimum = GC_MIN_HEAP;
+static int heapGrowth = GC_GROWTH_PERCENT;
+static size_t nextCollection = GC_MIN_HEAP;
+static size_t nurserySize = GC_NURSERY_SIZE;
+static size_t heapLimit = 0;
+
+// In region mode, everything allocated while a top-level form is evaluated
+// stays in the nursery until the form is done. See gcBeginRegion.
+static bool regionMode = false;
+static bool inRegion = false;
+
+// The root stack holds the addresses of the C variables registered with
+// gcPushRoot. It, the mark stack and the remembered set grow on demand.
+static void ***roots = NULL;
+static int rootCount = 0;
+static int rootCapacity = 0;
+
+// Objects waiting to have their children marked (major collections) or
+// promoted (minor collections).
+static Object **markStack = NULL;
+static size_t markCount = 0;
+static size_t markCapacity = 0;
+
+// Old objects that were written a pointer to a young object since the last
+// minor collection. See gcWriteBarrier.
+static Object **remembered = NULL;
+static size_t rememberedCount = 0;
+static size_t rememberedCapacity = 0;
+
+// The tables of frames with many bindings, which must be freed once their
+// frame is garbage. See gcTrackTable.
+static FrameTable **tables = NULL;
+static size_t tableCount = 0;
+static size_t tableCapacity = 0;
+
+// Arrays whose entries are all roots, such as the stack of the virtual
+// machine. See gcAddRootArray.
+typedef struct RootArray {
+    Object ***array;
+    size_t *count;
+} RootArray;
+
+static RootArray *rootArrays = NULL;
+static size_t rootArrayCount = 0;
+static size_t rootArrayCapacity = 0;
+
+// The bytecode of lambda bodies, which must be freed once its body is
+// garbage. See gcTrackCode.
+static Code **codes = NULL;
+static size_t codeCount = 0;
+static size_t codeCapacity = 0;
+
+static GcStats stats;
+
+// Input slot: The address of an Object * or Frame * variable.
+// Registers the variable as a root, so that whatever it points to survives
+// garbage collection. Every local that is still used after a call to eval
+// must be registered, because eval may collect. Roots are popped in the
+// reverse order they were pushed.
+void gcPushRoot(void *slot){
+    if (rootCount == rootCapacity) {
+        rootCapacity = rootCapacity == 0 ? 256 : rootCapacity * 2;
+        roots = realloc(roots, rootCapacity * sizeof(void **));
+        assert(roots != NULL);
+    }
+    roots[rootCount++] = (void **)slot;
+}
+
+// Input count: The number of roots to unregister.
+// Unregisters the most recently pushed roots.
+void gcPopRoots(int count){
+    assert(count <= rootCount);
+    rootCount -= count;
+}
+
+// Input array: The address of an array of Object * or Frame * variables. The
+// array may move (e.g. with realloc), as long as the variable at array is
+// kept pointing to it.
+// Input count: The address of the number of entries in use.
+// Registers the entries in use as roots, whatever their number at the time of
+// a collection, until gcRemoveRootArray.
+void gcAddRootArray(void *array, size_t *count){
+    if (rootArrayCount == rootArrayCapacity) {
+        rootArrayCapacity = rootArrayCapacity == 0 ? 16 : rootArrayCapacity * 2;
+        rootArrays = realloc(rootArrays, rootArrayCapacity * sizeof(RootArray));
+        assert(rootArrays != NULL);
+    }
+    rootArrays[rootArrayCount].array = (Object ***)array;
+    rootArrays[rootArrayCount].count = count;
+    rootArrayCount++;
+}
+
+// Input array: An address given to gcAddRootArray.
+// Unregisters the array.
+void gcRemoveRootArray(void *array){
+    for (size_t i = rootArrayCount; i > 0; i--) {
+        if (rootArrays[i - 1].array == (Object ***)array) {
+            rootArrays[i - 1] = rootArrays[--rootArrayCount];
+            return;
+        }
+    }
+    assert(false);
+}
+
+// Helper function
+// Input list: The address of a growable array of objects.
+// Input count: The address of the number of objects in it.
+// Input capacity: The address of its capacity.
+// Input obj: The object to append.
+static void push(Object ***list, size_t *count, size_t *capacity, Object *obj){
+    if (*count == *capacity) {
+        *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+        *list = realloc(*list, *capacity * sizeof(Object *));
+        assert(*list != NULL);
+    }
+    (*list)[(*count)++] = obj;
+}
+
+// Input holder: An Object or Frame that was just written to.
+// Input value: The Object or Frame that was stored into holder.
+// Must be called after storing a pointer into an object that may already be
+// old, so that a minor collection can find young objects that only an old
+// object points to.
+void gcWriteBarrier(void *holder, void *value){
+    if (value == NULL || isImmediate(value) || !tallocIsYoung(objectAddress(value))
+            || tallocIsYoung(holder)) {
+        return;
+    }
+    if (rememberedCount > 0 && remembered[rememberedCount - 1] == holder) {
+        return;
+    }
+    push(&remembered, &rememberedCount, &rememberedCapacity, (Object *)holder);
+}
+
+// Helper function
+// Input obj: A young object other than a ConsCell.
+// Return: The pool whose slabs hold old objects of the same kind.
+static poolClass poolOf(Object *obj){
+    switch (obj->type) {
+        case INT_TYPE: return INT_POOL;
+        case DOUBLE_TYPE: return DOUBLE_POOL;
+        case FRAME_TYPE: return tpoolForFrame(((Frame *)obj)->capacity);
+        case CLOSURE_TYPE: return CLOSURE_POOL;
+        default: assert(false); return INT_POOL;
+    }
+}
+
+// Helper function
+// Input obj: An Object or Frame, or NULL.
+// Return: Where obj lives after the minor collection. A young object is copied
+// into the old generation the first time it is reached and replaced by a
+// Forward; the copy is queued so that its children get promoted too.
+static Object *promote(Object *obj){
+    if (obj == NULL || isImmediate(obj) || !tallocIsYoung(objectAddress(obj))) {
+        return obj;
+    }
+    if (isCons(obj)) {
+        ConsCell *cell = consCell(obj);
+        if (cell->car == FORWARD_OBJECT) {
+            return cell->cdr;
+        }
+        ConsCell *copy = tallocTenured(CONS_POOL);
+        *copy = *cell;
+        stats.promotedBytes += sizeof(ConsCell);
+
+        cell->car = FORWARD_OBJECT;
+        cell->cdr = tagCons(copy);
+        push(&markStack, &markCount, &markCapacity, cell->cdr);
+        return cell->cdr;
+    }
+    if (obj->type == FORWARD_TYPE) {
+        return ((Forward *)obj)->to;
+    }
+    poolClass pool = poolOf(obj);
+    Object *copy = tallocTenured(pool);
+    memcpy(copy, obj, tpoolObjectSize(pool));
+    stats.promotedBytes += tpoolObjectSize(pool);
+
+    Forward *forward = (Forward *)obj;
+    forward->type = FORWARD_TYPE;
+    forward->to = copy;
+    push(&markStack, &markCount, &markCapacity, copy);
+    return copy;
+}
+
+// Helper function
+// Input obj: An old object.
+// Replaces every pointer in obj by where its target lives after promotion.
+static void promoteChildren(Object *obj){
+    if (isCons(obj)) {
+        ConsCell *cell = consCell(obj);
+        cell->car = promote(cell->car);
+        cell->cdr = promote(cell->cdr);
+    }
+    else if (obj->type == CLOSURE_TYPE) {
+        Closure *closure = (Closure *)obj;
+        closure->paramNames = promote(closure->paramNames);
+        closure->functionCode = promote(closure->functionCode);
+        closure->frame = (Frame *)promote((Object *)closure->frame);
+    }
+    else if (obj->type == FRAME_TYPE) {
+        Frame *frame = (Frame *)obj;
+        frame->bindings = promote(frame->bindings);
+        frame->parent = (Frame *)promote((Object *)frame->parent);
+        frame->names = promote(frame->names);
+        for (int i = 0; i < frame->count; i++) {
+            frame->slots[i] = promote(frame->slots[i]);
+        }
+        if (frame->table != NULL) {
+            frameUpdateTable(frame, promote);
+        }
+    }
+}
+
+// Helper function
+// Input young: Whether this is the end of a minor collection rather than the
+// marking phase of a major one.
+// Frees the tables whose frames are garbage. After a minor collection, the
+// table of a young frame that was promoted follows the frame to its new place.
+static void freeDeadTables(bool young){
+    size_t kept = 0;
+    for (size_t i = 0; i < tableCount; i++) {
+        FrameTable *table = tables[i];
+        Object *frame = (Object *)table->frame;
+        bool live;
+        if (!young) {
+            live = tpoolIsMarked(frame);
+        }
+        else if (!tallocIsYoung(frame)) {
+            live = true;
+        }
+        else {
+            live = frame->type == FORWARD_TYPE;
+            if (live) {
+                table->frame = (Frame *)((Forward *)frame)->to;
+            }
+        }
+        if (live) {
+            tables[kept++] = table;
+        }
+        else {
+            frameFreeTable(table);
+        }
+    }
+    tableCount = kept;
+}
+
+// Input table: The table of bindings that a frame was just given (see
+// frame.h).
+// The collector frees the table once its frame turns out to be garbage.
+void gcTrackTable(FrameTable *table){
+    if (tableCount == tableCapacity) {
+        tableCapacity = tableCapacity == 0 ? 64 : tableCapacity * 2;
+        tables = realloc(tables, tableCapacity * sizeof(FrameTable *));
+        assert(tables != NULL);
+    }
+    tables[tableCount++] = table;
+}
+
+// Helper function
+// Input young: Whether this is the end of a minor collection rather than the
+// marking phase of a major one.
+// Frees the bytecode whose lambda bodies are garbage, like freeDeadTables.
+static void freeDeadCode(bool young){
+    size_t kept = 0;
+    for (size_t i = 0; i < codeCount; i++) {
+        Code *code = codes[i];
+        Object *owner = code->owner;
+        bool live;
+        if (isImmediate(owner)) {
+            live = true;
+        }
+        else if (!young) {
+            live = tpoolIsMarked(objectAddress(owner));
+        }
+        else if (!tallocIsYoung(objectAddress(owner))) {
+            live = true;
+        }
+        else if (isCons(owner)) {
+            live = consCell(owner)->car == FORWARD_OBJECT;
+            if (live) {
+                code->owner = consCell(owner)->cdr;
+            }
+        }
+        else {
+            live = owner->type == FORWARD_TYPE;
+            if (live) {
+                code->owner = ((Forward *)owner)->to;
+            }
+        }
+        if (live) {
+            codes[kept++] = code;
+        }
+        else {
+            codeFree(code);
+        }
+    }
+    codeCount = kept;
+}
+
+// Input code: The bytecode of the body of a lambda (see bytecode.h).
+// The constants of the code are roots from now on, and the collector frees
+// the code once the body it was compiled from turns out to be garbage.
+void gcTrackCode(Code *code){
+    if (codeCount == codeCapacity) {
+        codeCapacity = codeCapacity == 0 ? 64 : codeCapacity * 2;
+        codes = realloc(codes, codeCapacity * sizeof(Code *));
+        assert(codes != NULL);
+    }
+    codes[codeCount++] = code;
+}
+
+// Helper function
+// Moves every young object that is reachable from the roots or from a
+// remembered old object into the old generation, then empties the nursery.
+static void minorCollect(){
+    clock_t start = clock();
+    for (int i = 0; i < rootCount; i++) {
+        *roots[i] = promote(*roots[i]);
+    }
+    for (size_t i = 0; i < rootArrayCount; i++) {
+        Object **array = *rootArrays[i].array;
+        for (size_t j = 0; j < *rootArrays[i].count; j++) {
+            array[j] = promote(array[j]);
+        }
+    }
+    for (size_t i = 0; i < codeCount; i++) {
+        for (size_t j = 0; j < codes[i]->constantCount; j++) {
+            codes[i]->constants[j] = promote(codes[i]->constants[j]);
+        }
+    }
+    for (size_t i = 0; i < rememberedCount; i++) {
+        promoteChildren(remembered[i]);
+    }
+    while (markCount > 0) {
+        promoteChildren(markStack[--markCount]);
+    }
+    rememberedCount = 0;
+    freeDeadTables(true);
+    freeDeadCode(true);
+    tnurseryReset(nurserySize);
+
+    double pause = (double)(clock() - start) / CLOCKS_PER_SEC;
+    stats.minorCollections++;
+    stats.minorPauseTotal += pause;
+    if (pause > stats.minorPauseMax) {
+        stats.minorPauseMax = pause;
+    }
+}
+
+// Helper function
+// Input obj: An Object or Frame, or NULL.
+// Marks obj if it is a pooled object that is not marked yet, and queues it so
+// that its children get marked as well.
+static void markLater(void *obj){
+    if (obj == NULL || isImmediate((Object *)obj) || !tpoolMark(objectAddress(obj))) {
+        return;
+    }
+    push(&markStack, &markCount, &markCapacity, (Object *)obj);
+}
+
+// Helper function
+// Marks everything reachable from the objects on the mark stack. An explicit
+// stack is used because lists and frame chains can be far deeper than the C
+// stack.
+static void markAll(){
+    while (markCount > 0) {
+        Object *obj = markStack[--markCount];
+        if (isCons(obj)) {
+            markLater(consCell(obj)->car);
+            markLater(consCell(obj)->cdr);
+        }
+        else if (obj->type == CLOSURE_TYPE) {
+            Closure *closure = (Closure *)obj;
+            markLater(closure->paramNames);
+            markLater(closure->functionCode);
+            markLater(closure->frame);
+        }
+        else if (obj->type == FRAME_TYPE) {
+            Frame *frame = (Frame *)obj;
+            markLater(frame->bindings);
+            markLater(frame->parent);
+            markLater(frame->names);
+            for (int i = 0; i < frame->count; i++) {
+                markLater(frame->slots[i]);
+            }
+        }
+    }
+}
+
+// Empties the nursery, then marks everything reachable from the roots and
+// returns every old object that was not reached to its pool.
+void gcCollect(){
+    if (tnurseryBytes() > 0) {
+        minorCollect();
+    }
+
+    clock_t start = clock();
+    for (int i = 0; i < rootCount; i++) {
+        markLater(*roots[i]);
+    }
+    for (size_t i = 0; i < rootArrayCount; i++) {
+        Object **array = *rootArrays[i].array;
+        for (size_t j = 0; j < *rootArrays[i].count; j++) {
+            markLater(array[j]);
+        }
+    }
+    for (size_t i = 0; i < codeCount; i++) {
+        for (size_t j = 0; j < codes[i]->constantCount; j++) {
+            markLater(codes[i]->constants[j]);
+        }
+    }
+    markAll();
+    freeDeadTables(false);
+    freeDeadCode(false);
+    tpoolSweep();
+
+    size_t live = tpoolBytes();
+    nextCollection = live / 100 * heapGrowth;
+    if (nextCollection < heapMinimum) {
+        nextCollection = heapMinimum;
+    }
+    if (heapLimit != 0 && live < heapLimit / 2 && nextCollection > heapLimit / 2) {
+        nextCollection = heapLimit / 2;
+    }
+
+    double pause = (double)(clock() - start) / CLOCKS_PER_SEC;
+    stats.majorCollections++;
+    stats.majorPauseTotal += pause;
+    if (pause > stats.majorPauseMax) {
+        stats.majorPauseMax = pause;
+    }
+}
+
+// A safe point: empties the nursery once it is full, and collects the old
+// generation once it has grown past its threshold. Called by eval before it
+// evaluates anything.
+void gcMaybeCollect(){
+    if (inRegion) {
+        return;
+    }
+    if (nurserySize > 0 && tnurseryBytes() >= nurserySize) {
+        minorCollect();
+    }
+    if (tpoolBytes() >= nextCollection) {
+        gcCollect();
+    }
+}
+
+// Input minHeap: The number of pooled bytes that must be live before the first
+// collection happens. Later collections never happen below this size either.
+// Input growthPercent: After a collection, the next one happens once the heap
+// has grown to this percentage of what survived (e.g. 200 doubles it), at
+// least 100. Zero keeps the percentage as it is.
+void gcSetThreshold(size_t minHeap, int growthPercent){
+    heapMinimum = minHeap;
+    if (growthPercent != 0) {
+        heapGrowth = growthPercent > 100 ? growthPercent : 100;
+    }
+    nextCollection = minHeap;
+    if (heapLimit != 0 && nextCollection > heapLimit / 2) {
+        nextCollection = heapLimit / 2;
+    }
+}
+
+// Input bytes: How many bytes of young objects to allocate between minor
+// collections. Zero turns the nursery off, so that every object is allocated
+// in the old generation and only full collections happen.
+void gcSetNurserySize(size_t bytes){
+    if (tnurseryBytes() > 0) {
+        minorCollect();
+    }
+    nurserySize = bytes;
+    tnurserySetEnabled(bytes > 0);
+}
+
+// Input bytes: The most memory the heap may hold, or zero for no limit.
+// Collections start early enough to keep the old generation below half of the
+// limit while that is possible. If the heap still outgrows the limit, the
+// program stops with an evaluation error (see tallocSetLimit).
+void gcSetHeapLimit(size_t bytes){
+    heapLimit = bytes;
+    tallocSetLimit(bytes);
+    if (heapLimit != 0 && nextCollection > heapLimit / 2) {
+        nextCollection = heapLimit / 2;
+    }
+}
+
+// Input enabled: Whether interpret should evaluate each top-level form in a
+// region of its own.
+void gcSetRegionMode(bool enabled){
+    regionMode = enabled;
+}
+
+// Starts the region of a top-level form, if region mode is on. Until
+// gcEndRegion, every new object goes to the nursery, which grows as needed,
+// and no collection happens at all.
+void gcBeginRegion(){
+    if (!regionMode) {
+        return;
+    }
+    inRegion = true;
+    tnurserySetEnabled(true);
+}
+
+// Ends the region of a top-level form, if region mode is on. Whatever the
+// roots can still reach (definitions in the global frame, closures they
+// capture, the rest of the program) is moved into the old generation, and the
+// rest of the region is thrown away in one go. The old generation is then
+// collected if it has grown past its threshold.
+void gcEndRegion(){
+    if (!regionMode) {
+        return;
+    }
+    if (tnurseryBytes() > 0) {
+        minorCollect();
+    }
+    inRegion = false;
+    tnurserySetEnabled(nurserySize > 0);
+    if (tpoolBytes() >= nextCollection) {
+        gcCollect();
+    }
+}
+
+// Return: Counters and pause times of all collections so far.
+GcStats gcStats(){
+    return stats;
+}
+
+// Prints the collection counters and pause times to stderr.
+void gcPrintStats(){
+    fprintf(stderr, "minor collections: %zu (total pause %.3f ms, max %.3f ms)\n",
+            stats.minorCollections, stats.minorPauseTotal * 1000, stats.minorPauseMax * 1000);
+    fprintf(stderr, "major collections: %zu (total pause %.3f ms, max %.3f ms)\n",
+            stats.majorCollections, stats.majorPauseTotal * 1000, stats.majorPauseMax * 1000);
+    fprintf(stderr, "promoted: %zu bytes\n", stats.promotedBytes);
+}
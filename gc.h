@@ -0,0 +1,107 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "object.h"
+
+#ifndef _GC
+#define _GC
+
+// Input slot: The address of an Object * or Frame * variable.
+// Registers the variable as a root, so that whatever it points to survives
+// garbage collection. Every local that is still used after a call to eval
+// must be registered, because eval may collect. Roots are popped in the
+// reverse order they were pushed.
+void gcPushRoot(void *slot);
+
+// Input count: The number of roots to unregister.
+// Unregisters the most recently pushed roots.
+void gcPopRoots(int count);
+
+// Input array: The address of an array of Object * or Frame * variables. The
+// array may move (e.g. with realloc), as long as the variable at array is
+// kept pointing to it.
+// Input count: The address of the number of entries in use.
+// Registers the entries in use as roots, whatever their number at the time of
+// a collection, until gcRemoveRootArray.
+void gcAddRootArray(void *array, size_t *count);
+
+// Input array: An address given to gcAddRootArray.
+// Unregisters the array.
+void gcRemoveRootArray(void *array);
+
+// Counters and pause times (in seconds of processor time) of the collections
+// so far.
+typedef struct GcStats {
+    size_t minorCollections;
+    double minorPauseTotal;
+    double minorPauseMax;
+    size_t majorCollections;
+    double majorPauseTotal;
+    double majorPauseMax;
+    size_t promotedBytes;
+} GcStats;
+
+// Input holder: An Object or Frame that was just written to.
+// Input value: The Object or Frame that was stored into holder.
+// Must be called after storing a pointer into an object that may already be
+// old, so that a minor collection can find young objects that only an old
+// object points to.
+void gcWriteBarrier(void *holder, void *value);
+
+// Input table: The table of bindings that a frame was just given (see
+// frame.h).
+// The collector frees the table once its frame turns out to be garbage.
+void gcTrackTable(struct FrameTable *table);
+
+// Input code: The bytecode of the body of a lambda (see bytecode.h).
+// The constants of the code are roots from now on, and the collector frees
+// the code once the body it was compiled from turns out to be garbage.
+void gcTrackCode(struct Code *code);
+
+// A safe point: empties the nursery once it is full, and collects the old
+// generation once it has grown past its threshold. Called by eval before it
+// evaluates anything.
+void gcMaybeCollect();
+
+// Empties the nursery, then marks everything reachable from the roots and
+// returns every old object that was not reached to its pool.
+void gcCollect();
+
+// Input minHeap: The number of pooled bytes that must be live before the first
+// collection happens. Later collections never happen below this size either.
+// Input growthPercent: After a collection, the next one happens once the heap
+// has grown to this percentage of what survived (e.g. 200 doubles it), at
+// least 100. Zero keeps the percentage as it is.
+void gcSetThreshold(size_t minHeap, int growthPercent);
+
+// Input bytes: How many bytes of young objects to allocate between minor
+// collections. Zero turns the nursery off, so that every object is allocated
+// in the old generation and only full collections happen.
+void gcSetNurserySize(size_t bytes);
+
+// Input bytes: The most memory the heap may hold, or zero for no limit.
+// Collections start early enough to keep the old generation below half of the
+// limit while that is possible. If the heap still outgrows the limit, the
+// program stops with an evaluation error (see tallocSetLimit).
+void gcSetHeapLimit(size_t bytes);
+
+// Input enabled: Whether interpret should evaluate each top-level form in a
+// region of its own.
+void gcSetRegionMode(bool enabled);
+
+// Starts the region of a top-level form, if region mode is on. Until
+// gcEndRegion, every new object goes to the nursery, which grows as needed,
+// and no collection happens at all.
+void gcBeginRegion();
+
+// Ends the region of a top-level form, if region mode is on. Whatever the
+// roots can still reach is moved into the old generation, and the rest of the
+// region is thrown away in one go.
+void gcEndRegion();
+
+// Return: Counters and pause times of all collections so far.
+GcStats gcStats();
+
+// Prints the collection counters and pause times to stderr.
+void gcPrintStats();
+
+#endif
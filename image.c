@@ -0,0 +1,532 @@
+// image.c by Leon Liang
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "object.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "tokenizer.h"
+#include "interpreter.h"
+#include "image.h"
+
+// A heap image file starts with an ImageHeader, padded to one block (see
+// tallocBlockSize). Then come the blocks, laid out exactly like the
+// allocator's own: a pool's objects in slabs of that pool, symbols, strings,
+// primitives and their text in blocks that are never collected. Last come
+// three tables:
+//   relocations: the file offset of every pointer in the blocks
+//   primitives:  the file offset of every Primitive's function pointer and
+//                the position of the primitive in the interpreter's table
+//   symbols:     the file offset of every Symbol
+// Pointers are saved as if the file had been mapped at IMAGE_BASE. If it can
+// be mapped there, it is used as it is and only the pages that the program
+// touches are ever read; otherwise every pointer is moved by the difference.
+// Function pointers differ from run to run, so they are always filled in.
+#define IMAGE_MAGIC "SCMIMG3"
+#define IMAGE_BASE ((uintptr_t)0x200000000000)
+
+typedef struct ImageHeader {
+    char magic[8];
+    uint64_t base;                  // the address the pointers assume
+    uint64_t blockSize;             // tallocBlockSize of the saving program
+    uint64_t poolSizes[NUM_POOLS];  // tpoolObjectSize of the saving program
+    uint64_t blockBytes;            // how much the blocks span
+    uint64_t frame;                 // the global frame
+    uint64_t relocations;           // file offset of the relocations table
+    uint64_t relocationCount;
+    uint64_t primitives;            // file offset of the primitives table
+    uint64_t primitiveCount;
+    uint64_t symbols;               // file offset of the symbols table
+    uint64_t symbolCount;
+} ImageHeader;
+
+// A growing array of 64-bit numbers on the C heap.
+typedef struct Words {
+    uint64_t *data;
+    size_t count;
+    size_t capacity;
+} Words;
+
+// Helper function
+// Input words: A Words.
+// Input word: The number to append.
+static void pushWord(Words *words, uint64_t word){
+    if (words->count == words->capacity) {
+        words->capacity = words->capacity == 0 ? 1024 : words->capacity * 2;
+        words->data = realloc(words->data, words->capacity * sizeof(uint64_t));
+        if (words->data == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+    }
+    words->data[words->count++] = word;
+}
+
+// The image while it is being saved. Objects are copied into it breadth
+// first: the first time an object is reached, room is made for it and it is
+// queued; its fields are filled in once it leaves the queue.
+typedef struct ImageWriter {
+    char *data;                     // the file up to the end of the blocks
+    size_t length;
+    size_t capacity;
+    size_t blockSize;
+    size_t slab[NUM_POOLS];         // the block each pool is filling, or 0
+    size_t slot[NUM_POOLS];         // the next slot in it
+    size_t arenaPtr;                // the next free byte of the text block
+    size_t arenaEnd;                // the end of the text block
+    uintptr_t *keys;                // addresses of objects copied, or 0
+    uint64_t *values;               // where each of them went
+    size_t mapCapacity;
+    size_t mapCount;
+    Words queue;                    // objects whose fields are not filled in
+    size_t queued;                  // how many of them have been handled
+    Words relocations;
+    Words primitives;
+    Words symbols;
+} ImageWriter;
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input size: The size of the block, a multiple of the block size.
+// Input pool: The pool of the block, or NUM_POOLS.
+// Return: The file offset of a new, empty block at the end of the image.
+static size_t addBlock(ImageWriter *writer, size_t size, int pool){
+    if (writer->length + size > writer->capacity) {
+        while (writer->length + size > writer->capacity) {
+            writer->capacity *= 2;
+        }
+        writer->data = realloc(writer->data, writer->capacity);
+        if (writer->data == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+    }
+    size_t offset = writer->length;
+    memset(writer->data + offset, 0, size);
+    writer->length += size;
+    tallocInitBlock(writer->data + offset, size, pool);
+    return offset;
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input pool: A pool.
+// Return: The file offset of room for an object of that pool.
+static size_t placeObject(ImageWriter *writer, poolClass pool){
+    void *obj = NULL;
+    if (writer->slab[pool] != 0) {
+        obj = tallocBlockObject(writer->data + writer->slab[pool], writer->slot[pool]);
+    }
+    if (obj == NULL) {
+        writer->slab[pool] = addBlock(writer, writer->blockSize, pool);
+        writer->slot[pool] = 0;
+        obj = tallocBlockObject(writer->data + writer->slab[pool], 0);
+    }
+    writer->slot[pool]++;
+    return (char *)obj - writer->data;
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input size: The number of bytes needed.
+// Return: The file offset of room for size bytes that are never collected,
+// such as a Symbol or the text of a string.
+static size_t placeBytes(ImageWriter *writer, size_t size){
+    size = (size + 7) & ~(size_t)7;
+    if (writer->arenaPtr + size <= writer->arenaEnd) {
+        writer->arenaPtr += size;
+        return writer->arenaPtr - size;
+    }
+    if (size > writer->blockSize / 4) {
+        // Long text gets a block of its own, like a large talloc, with room
+        // for the header of the block in front of it
+        size_t blockBytes = (tallocArenaHeader() + size + writer->blockSize - 1)
+                & ~(writer->blockSize - 1);
+        size_t offset = addBlock(writer, blockBytes, NUM_POOLS);
+        return offset + tallocInitBlock(writer->data + offset, blockBytes, NUM_POOLS);
+    }
+    size_t offset = addBlock(writer, writer->blockSize, NUM_POOLS);
+    writer->arenaPtr = offset + tallocInitBlock(writer->data + offset, writer->blockSize, NUM_POOLS);
+    writer->arenaEnd = offset + writer->blockSize;
+    writer->arenaPtr += size;
+    return writer->arenaPtr - size;
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input address: The address of an object.
+// Return: Where in the map's arrays the object is or would go.
+static size_t mapSlot(ImageWriter *writer, uintptr_t address){
+    size_t slot = (address >> 3) & (writer->mapCapacity - 1);
+    while (writer->keys[slot] != 0 && writer->keys[slot] != address) {
+        slot = (slot + 1) & (writer->mapCapacity - 1);
+    }
+    return slot;
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input obj: Any Object, Frame or NULL.
+// Return: The word that stands for obj in the image. Immediates stand for
+// themselves; an object that is seen for the first time is given room in the
+// image and queued, so that its fields are filled in later.
+static uint64_t imageWord(ImageWriter *writer, Object *obj){
+    if (obj == NULL || isImmediate(obj)) {
+        return (uint64_t)(uintptr_t)obj;
+    }
+    uintptr_t address = (uintptr_t)objectAddress(obj);
+    size_t slot = mapSlot(writer, address);
+    if (writer->keys[slot] != 0) {
+        return writer->values[slot];
+    }
+
+    size_t offset;
+    switch (typeOf(obj)) {
+        case CONS_TYPE: offset = placeObject(writer, CONS_POOL); break;
+        case INT_TYPE: offset = placeObject(writer, INT_POOL); break;
+        case DOUBLE_TYPE: offset = placeObject(writer, DOUBLE_POOL); break;
+        case FRAME_TYPE:
+            offset = placeObject(writer, tpoolForFrame(((Frame *)obj)->capacity));
+            break;
+        case CLOSURE_TYPE: offset = placeObject(writer, CLOSURE_POOL); break;
+        case SYMBOL_TYPE: offset = placeBytes(writer, sizeof(Symbol)); break;
+        case STR_TYPE: offset = placeBytes(writer, sizeof(String)); break;
+        case PRIMITIVE_TYPE: offset = placeBytes(writer, sizeof(Primitive)); break;
+        default:
+            printf("Error: cannot save a %s in a heap image\n", typeName(typeOf(obj)));
+            texit(1);
+            return 0;
+    }
+    uint64_t word = (IMAGE_BASE + offset) | ((uintptr_t)obj & TAG_MASK);
+
+    writer->keys[slot] = address;
+    writer->values[slot] = word;
+    writer->mapCount++;
+    if (2 * writer->mapCount > writer->mapCapacity) {
+        uintptr_t *keys = writer->keys;
+        uint64_t *values = writer->values;
+        size_t capacity = writer->mapCapacity;
+        writer->mapCapacity *= 2;
+        writer->keys = calloc(writer->mapCapacity, sizeof(uintptr_t));
+        writer->values = malloc(writer->mapCapacity * sizeof(uint64_t));
+        if (writer->keys == NULL || writer->values == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            if (keys[i] != 0) {
+                size_t newSlot = mapSlot(writer, keys[i]);
+                writer->keys[newSlot] = keys[i];
+                writer->values[newSlot] = values[i];
+            }
+        }
+        free(keys);
+        free(values);
+    }
+    pushWord(&writer->queue, (uint64_t)(uintptr_t)obj);
+    return word;
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input offset: The file offset of a pointer field.
+// Input value: What the field points to in the running program.
+// Fills in the field, and remembers it for relocation if it is a pointer.
+static void setField(ImageWriter *writer, size_t offset, void *value){
+    uint64_t word = imageWord(writer, value);
+    memcpy(writer->data + offset, &word, sizeof(word));
+    if (word != 0 && !isImmediate((Object *)(uintptr_t)word)) {
+        pushWord(&writer->relocations, offset);
+    }
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input offset: The file offset of a char * field.
+// Input text: The string the field points to in the running program.
+// Copies the string into the image and points the field at the copy.
+static void setText(ImageWriter *writer, size_t offset, char *text){
+    size_t length = strlen(text) + 1;
+    size_t copy = placeBytes(writer, length);
+    memcpy(writer->data + copy, text, length);
+    uint64_t word = IMAGE_BASE + copy;
+    memcpy(writer->data + offset, &word, sizeof(word));
+    pushWord(&writer->relocations, offset);
+}
+
+// Helper function
+// Input writer: An ImageWriter.
+// Input obj: A queued object.
+// Copies obj into the room that was made for it, with every pointer replaced
+// by the word of what it points to.
+static void fillObject(ImageWriter *writer, Object *obj){
+    uint64_t word = imageWord(writer, obj);
+    size_t offset = (word & ~(uint64_t)TAG_MASK) - IMAGE_BASE;
+    if (isCons(obj)) {
+        ConsCell *cell = consCell(obj);
+        setField(writer, offset + offsetof(ConsCell, car), cell->car);
+        setField(writer, offset + offsetof(ConsCell, cdr), cell->cdr);
+        return;
+    }
+    switch (obj->type) {
+        case INT_TYPE:
+            memcpy(writer->data + offset, obj, sizeof(Integer));
+            break;
+        case DOUBLE_TYPE:
+            memcpy(writer->data + offset, obj, sizeof(Double));
+            break;
+        case FRAME_TYPE: {
+            Frame *frame = (Frame *)obj;
+            memcpy(writer->data + offset, frame, sizeof(Frame));
+            setField(writer, offset + offsetof(Frame, bindings), frame->bindings);
+            setField(writer, offset + offsetof(Frame, parent), frame->parent);
+            setField(writer, offset + offsetof(Frame, names), frame->names);
+            for (int i = 0; i < frame->count; i++) {
+                setField(writer, offset + offsetof(Frame, slots) + i * sizeof(Object *), frame->slots[i]);
+            }
+            // The table of a big frame is made again when it is first needed
+            memset(writer->data + offset + offsetof(Frame, table), 0, sizeof(frame->table));
+            break;
+        }
+        case CLOSURE_TYPE: {
+            Closure *closure = (Closure *)obj;
+            memcpy(writer->data + offset, closure, sizeof(Closure));
+            setField(writer, offset + offsetof(Closure, paramNames), closure->paramNames);
+            setField(writer, offset + offsetof(Closure, functionCode), closure->functionCode);
+            setField(writer, offset + offsetof(Closure, frame), closure->frame);
+            // The bytecode of the body is compiled again when it is first needed
+            memset(writer->data + offset + offsetof(Closure, code), 0, sizeof(closure->code));
+            break;
+        }
+        case SYMBOL_TYPE:
+            memcpy(writer->data + offset, obj, sizeof(Symbol));
+            setText(writer, offset + offsetof(Symbol, value), ((Symbol *)obj)->value);
+            pushWord(&writer->symbols, offset);
+            break;
+        case STR_TYPE:
+            memcpy(writer->data + offset, obj, sizeof(String));
+            setText(writer, offset + offsetof(String, value), ((String *)obj)->value);
+            break;
+        case PRIMITIVE_TYPE: {
+            Primitive *primitive = (Primitive *)obj;
+            memcpy(writer->data + offset, primitive, sizeof(Primitive));
+            int index = 0;
+            while (primitiveFunction(index) != primitive->pf) {
+                if (primitiveFunction(index) == NULL) {
+                    printf("Error: cannot save an unknown primitive in a heap image\n");
+                    texit(1);
+                }
+                index++;
+            }
+            memset(writer->data + offset + offsetof(Primitive, pf), 0, sizeof(primitive->pf));
+            pushWord(&writer->primitives, offset + offsetof(Primitive, pf));
+            pushWord(&writer->primitives, index);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Input path: Where to save the image.
+// Saves everything that the global frame can reach (its bindings, the
+// closures and their code, the symbols, strings and numbers they use) to a
+// heap image file, so that a later run can start from it with loadImage
+// instead of evaluating the same definitions again.
+void dumpImage(char *path){
+    ImageWriter writer;
+    memset(&writer, 0, sizeof(ImageWriter));
+    writer.blockSize = tallocBlockSize();
+    writer.capacity = 16 * writer.blockSize;
+    writer.data = calloc(writer.capacity, 1);
+    writer.mapCapacity = 1024;
+    writer.keys = calloc(writer.mapCapacity, sizeof(uintptr_t));
+    writer.values = malloc(writer.mapCapacity * sizeof(uint64_t));
+    if (writer.data == NULL || writer.keys == NULL || writer.values == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    // The header takes the first block, so that the other blocks are aligned
+    writer.length = writer.blockSize;
+
+    ImageHeader header;
+    memset(&header, 0, sizeof(ImageHeader));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.base = IMAGE_BASE;
+    header.blockSize = writer.blockSize;
+    for (int i = 0; i < NUM_POOLS; i++) {
+        header.poolSizes[i] = tpoolObjectSize(i);
+    }
+    header.frame = imageWord(&writer, (Object *)globalEnvironment());
+    while (writer.queued < writer.queue.count) {
+        fillObject(&writer, (Object *)(uintptr_t)writer.queue.data[writer.queued++]);
+    }
+    header.blockBytes = writer.length - writer.blockSize;
+    header.relocations = writer.length;
+    header.relocationCount = writer.relocations.count;
+    header.primitives = header.relocations + writer.relocations.count * sizeof(uint64_t);
+    header.primitiveCount = writer.primitives.count / 2;
+    header.symbols = header.primitives + writer.primitives.count * sizeof(uint64_t);
+    header.symbolCount = writer.symbols.count;
+    memcpy(writer.data, &header, sizeof(ImageHeader));
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0
+            && writeAll(fd, writer.data, writer.length)
+            && writeAll(fd, writer.relocations.data, writer.relocations.count * sizeof(uint64_t))
+            && writeAll(fd, writer.primitives.data, writer.primitives.count * sizeof(uint64_t))
+            && writeAll(fd, writer.symbols.data, writer.symbols.count * sizeof(uint64_t));
+    if (fd >= 0 && close(fd) != 0) {
+        ok = false;
+    }
+    free(writer.data);
+    free(writer.keys);
+    free(writer.values);
+    free(writer.queue.data);
+    free(writer.relocations.data);
+    free(writer.primitives.data);
+    free(writer.symbols.data);
+    if (!ok) {
+        printf("Error: cannot write %s\n", path);
+        texit(1);
+    }
+}
+
+// Helper function
+// Input path: The image file, for the error message.
+// Prints that path is not a usable heap image and cleanly exits.
+static void imageError(char *path){
+    printf("Error: %s is not a heap image of this interpreter\n", path);
+    texit(1);
+}
+
+// Helper function
+// Input fd: An open image file.
+// Input size: The size of the file.
+// Input blockSize: The alignment the mapping needs.
+// Return: The file mapped at some multiple of blockSize, or MAP_FAILED.
+static char *mapAligned(int fd, size_t size, size_t blockSize){
+    char *reserved = mmap(NULL, size + blockSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    char *aligned = (char *)(((uintptr_t)reserved + blockSize - 1) & ~(uintptr_t)(blockSize - 1));
+    char *map = mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (map == MAP_FAILED) {
+        munmap(reserved, size + blockSize);
+        return MAP_FAILED;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    char *mapEnd = aligned + ((size + page - 1) & ~(page - 1));
+    if (aligned > reserved) {
+        munmap(reserved, aligned - reserved);
+    }
+    if (reserved + size + blockSize > mapEnd) {
+        munmap(mapEnd, reserved + size + blockSize - mapEnd);
+    }
+    return map;
+}
+
+// Helper function
+// Input header: The header of an image file.
+// Input size: The size of the file.
+// Input offset: A file offset from one of the tables.
+// Return: True if a word at offset lies within the blocks.
+static bool inBlocks(ImageHeader *header, size_t offset){
+    return offset >= header->blockSize && offset % 8 == 0
+            && offset + 8 <= header->blockSize + header->blockBytes;
+}
+
+// Input path: A heap image file, as saved by dumpImage.
+// Maps the image into memory and makes its global frame the one that the
+// program is evaluated in. Must be called before anything is parsed or
+// evaluated, since the symbols of the program must be those of the image.
+// The time this takes grows with the number of blocks and symbols in the
+// image, not with the number of objects.
+void loadImage(char *path){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: cannot open %s\n", path);
+        texit(1);
+    }
+    ImageHeader header;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(ImageHeader)) != sizeof(ImageHeader)) {
+        imageError(path);
+    }
+    size_t size = st.st_size;
+    bool ok = memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) == 0
+            && header.blockSize == tallocBlockSize()
+            && header.blockBytes % header.blockSize == 0
+            && header.relocations == header.blockSize + header.blockBytes
+            && header.primitives == header.relocations + header.relocationCount * 8
+            && header.symbols == header.primitives + header.primitiveCount * 16
+            && size == header.symbols + header.symbolCount * 8;
+    for (int i = 0; i < NUM_POOLS; i++) {
+        ok = ok && header.poolSizes[i] == tpoolObjectSize(i);
+    }
+    if (!ok) {
+        imageError(path);
+    }
+
+    // Map the image where its pointers point, if that place is free
+    char *map = mmap((void *)(uintptr_t)header.base, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED && map != (char *)(uintptr_t)header.base) {
+        munmap(map, size);
+        map = mapAligned(fd, size, header.blockSize);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Error: cannot map %s\n", path);
+        texit(1);
+    }
+
+    uint64_t delta = (uintptr_t)map - header.base;
+    uint64_t *relocations = (uint64_t *)(map + header.relocations);
+    if (delta != 0) {
+        for (uint64_t i = 0; i < header.relocationCount; i++) {
+            if (!inBlocks(&header, relocations[i])) {
+                imageError(path);
+            }
+            *(uint64_t *)(map + relocations[i]) += delta;
+        }
+    }
+    uint64_t *primitives = (uint64_t *)(map + header.primitives);
+    for (uint64_t i = 0; i < header.primitiveCount; i++) {
+        PrimitiveFunction function = primitiveFunction(primitives[2 * i + 1]);
+        if (!inBlocks(&header, primitives[2 * i]) || function == NULL) {
+            imageError(path);
+        }
+        memcpy(map + primitives[2 * i], &function, sizeof(function));
+    }
+    // The global frame must be a frame that the image holds
+    size_t frameOffset = header.frame - header.base;
+    if (!inBlocks(&header, frameOffset)) {
+        imageError(path);
+    }
+    Frame *frame = (Frame *)(map + frameOffset);
+    int framePool = tallocBlockPool(map + header.blockSize, header.blockBytes, frame);
+    if (framePool < 0 || frame->type != FRAME_TYPE || frame->capacity > FRAME_SLOTS_MAX
+            || framePool != (int)tpoolForFrame(frame->capacity)) {
+        imageError(path);
+    }
+    tallocAddBlocks(map + header.blockSize, header.blockBytes);
+
+    uint64_t *symbols = (uint64_t *)(map + header.symbols);
+    for (uint64_t i = 0; i < header.symbolCount; i++) {
+        if (!inBlocks(&header, symbols[i]) || !internSymbol((Symbol *)(map + symbols[i]))) {
+            imageError(path);
+        }
+    }
+    setGlobalEnvironment(frame);
+}
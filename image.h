@@ -0,0 +1,21 @@
+#include "object.h"
+
+#ifndef _IMAGE
+#define _IMAGE
+
+// Input path: Where to save the image.
+// Saves everything that the global frame can reach (its bindings, the
+// closures and their code, the symbols, strings and numbers they use) to a
+// heap image file, so that a later run can start from it with loadImage
+// instead of evaluating the same definitions again.
+void dumpImage(char *path);
+
+// Input path: A heap image file, as saved by dumpImage.
+// Maps the image into memory and makes its global frame the one that the
+// program is evaluated in. Must be called before anything is parsed or
+// evaluated, since the symbols of the program must be those of the image.
+// The time this takes grows with the number of blocks and symbols in the
+// image, not with the number of objects.
+void loadImage(char *path);
+
+#endif
@@ -2,34 +2,125 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "object.h"
 #include "talloc.h"
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
-
-// Helper function
-// Deal with errors
+#include "gc.h"
+#include "symbol.h"
+#include "frame.h"
+#include "resolve.h"
+#include "vm.h"
+#include "nodes.h"
+
+// The engine that runs top-level expressions (see setEngine)
+static Engine engine = AST_ENGINE;
+
+// Prints that the evaluation failed and exits.
+// Return: Never returns; the return type lets callers write
+// return evaluationError().
 Object *evaluationError(){
     printf("Evaluation error\n");
     texit(1);
     return NULL;
 }
 
+// Input tree: An if expression.
+// Return: True if it has a condition, a then branch and at most an else
+// branch.
+bool checkIf(Object *tree){
+    Object *conditionCons = cdr(tree);
+    if (!isCons(conditionCons)) {
+        return false; // Too few arguments
+    }
+    Object *thenCons = cdr(conditionCons);
+    if (!isCons(thenCons)) {
+        return false; // Too few arguments
+    }
+    Object *elseCons = cdr(thenCons);
+    return !isCons(elseCons) || !isCons(cdr(elseCons)); // Too many arguments
+}
+
+// Input tree: A let expression.
+// Input count: Where to store how many bindings come before the first one
+// that is wrong, or all of them if none is.
+// Return: True if the bindings are a proper list of (symbol value) pairs with
+// no symbol twice.
+bool checkLet(Object *tree, int *count){
+    *count = 0;
+    Object *pairRootRoot = cdr(tree);
+    if (!isCons(pairRootRoot)) {
+        return false; // No var val pairs after let
+    }
+    Object *pairRoot = car(pairRootRoot);
+    if (!isCons(pairRoot) && pairRoot != NULL_OBJECT) {
+        return false; // Bindings should be a list
+    }
+    Object *current = pairRoot;
+    for (; isCons(current); current = cdr(current)) {
+        Object *pair = car(current);
+        if (!isCons(pair) || !isCons(cdr(pair)) || typeOf(car(pair)) != SYMBOL_TYPE) {
+            return false; // Missing var or val
+        }
+        for (Object *earlier = pairRoot; earlier != current; earlier = cdr(earlier)) {
+            if (car(car(earlier)) == car(pair)) {
+                return false; // Duplicate variable found
+            }
+        }
+        (*count)++;
+    }
+    return current == NULL_OBJECT;
+}
+
+// Input tree: A quote expression.
+// Return: True if it quotes exactly one expression.
+bool checkQuote(Object *tree){
+    Object *list = cdr(tree);
+    return isCons(list) && cdr(list) == NULL_OBJECT;
+}
+
+// Input tree: A define expression.
+// Return: True if it has a symbol and one expression for its value.
+bool checkDefine(Object *tree){
+    return isCons(cdr(tree)) && isCons(cdr(cdr(tree))) && cdr(cdr(cdr(tree))) == NULL_OBJECT
+            && typeOf(car(cdr(tree))) == SYMBOL_TYPE;
+}
+
+// Input tree: A lambda expression.
+// Return: True if its parameters are a proper list of symbols with no symbol
+// twice, and it has a body.
+bool checkLambda(Object *tree){
+    if (!isCons(cdr(tree))) {
+        return false;
+    }
+    Object *currentParam = car(cdr(tree));
+    for (; isCons(currentParam); currentParam = cdr(currentParam)) {
+        if (typeOf(car(currentParam)) != SYMBOL_TYPE) {
+            return false; // Each parameter must be a symbol
+        }
+        for (Object *check = cdr(currentParam); isCons(check); check = cdr(check)) {
+            if (car(currentParam) == car(check)) {
+                return false; // Duplicate parameter found
+            }
+        }
+    }
+    if (currentParam != NULL_OBJECT) {
+        return false;
+    }
+    return cdr(cdr(tree)) != NULL_OBJECT; // Missing body expression
+}
+
 // Helper function
 // Look up a symbol in the given frame
 // Note: the cdr of a binding is the value object
 Object *evalSymbol(Object *tree, Frame *frame) {
-    Symbol *symbol = (Symbol *)tree;
     while (frame != NULL) {
-        Object *current = frame->bindings;
-        while (current->type != NULL_TYPE) {
-            Object *binding = car(current);
-            if (strcmp(((Symbol *)car(binding))->value, symbol->value) == 0) {
-                return cdr(binding);
-            }
-            current = cdr(current);
+        Object **value = frameLookup(frame, tree);
+        if (value != NULL) {
+            return *value;
         }
         frame = frame->parent;
     }
@@ -37,195 +128,154 @@ Object *evalSymbol(Object *tree, Frame *frame) {
 }
 
 // Helper function
-// Evaluate an if expression
-Object *evalIf(Object *tree, Frame *frame) {
-    Object *conditionCons = cdr(tree);
-    if (conditionCons->type != CONS_TYPE) {
-        return evaluationError(); // Too few arguments
+// Look up a local variable by its frame and slot (see resolve.h)
+Object *evalLocal(Object *tree, Frame *frame) {
+    for (uintptr_t depth = localDepth(tree); depth > 0; depth--) {
+        frame = frame->parent;
     }
-    Object *thenCons = cdr(cdr(tree));
-    if (thenCons->type != CONS_TYPE) {
-        return evaluationError(); // Too few arguments
+    return frame->slots[localSlot(tree)];
+}
+
+// Helper function
+// Evaluate an if expression. The branch that is taken is in tail position: it
+// is not evaluated here, but left in tree for eval to go on with, and NULL is
+// returned. An if without an else branch whose condition is false returns
+// unspecified right away.
+Object *evalIf(Object **treeSlot, Frame **frameSlot) {
+    Object *tree = *treeSlot;
+    if (!checkIf(tree)) {
+        return evaluationError();
     }
+    Object *conditionCons = cdr(tree);
+    Object *thenCons = cdr(cdr(tree));
     Object *elseCons = cdr(cdr(cdr(tree)));
-    if (elseCons->type == CONS_TYPE && cdr(elseCons)->type == CONS_TYPE){
-        return evaluationError(); // Too many arguments
-    }
-    
-    Object *condResult = eval(car(conditionCons), frame);
-    if (condResult->type != BOOL_TYPE || ((Boolean *)condResult)->value == 1) {
-        return eval(car(thenCons), frame);
+
+    gcPushRoot(&thenCons);
+    gcPushRoot(&elseCons);
+    Object *condResult = eval(car(conditionCons), *frameSlot);
+    gcPopRoots(2);
+    if (condResult != FALSE_OBJECT) {
+        *treeSlot = car(thenCons);
+        return NULL;
     } else {
-        if (elseCons->type == CONS_TYPE) {
-            return eval(car(elseCons), frame);
+        if (typeOf(elseCons) == CONS_TYPE) {
+            *treeSlot = car(elseCons);
+            return NULL;
         } else {
-            Object *unspecified = talloc(sizeof(Object));
-            unspecified->type = UNSPECIFIED_TYPE;
-            return unspecified;
+            return UNSPECIFIED_OBJECT;
         }
     }
     return evaluationError();
 }
 
 // Helper function
-// Evaluate a let expression
-Object *evalLet(Object *tree, Frame *frame) {
-    Frame *letFrame = talloc(sizeof(Frame));
-    letFrame->parent = frame;
-    letFrame->bindings = makeNull();
-    
-    Object *pairRootRoot = cdr(tree);
-    if (pairRootRoot->type != CONS_TYPE){
-        return evaluationError(); // No var val pairs after let
+// Evaluate every expression of a body (a non-empty list) but the last, and
+// return the last, which is in tail position. frameSlot must be registered
+// with the collector by the caller, since the frame may move.
+Object *evalBody(Object *body, Frame **frameSlot) {
+    gcPushRoot(&body);
+    while (cdr(body) != NULL_OBJECT) {
+        eval(car(body), *frameSlot);
+        body = cdr(body);
+    }
+    gcPopRoots(1);
+    return car(body);
+}
+
+// Helper function
+// Evaluate a let expression. Like evalIf, leaves the last expression of the
+// body in tree and the frame of the let in frame for eval to go on with.
+Object *evalLet(Object **treeSlot, Frame **frameSlot) {
+    Object *tree = *treeSlot;
+    Frame *frame = *frameSlot;
+    // The values of the bindings before a wrong one are computed before the
+    // let fails
+    int count;
+    bool valid = checkLet(tree, &count);
+    if (count == 0 && !valid) {
+        return evaluationError();
     }
     Object *pairRoot = car(cdr(tree));
-    if (pairRoot->type != CONS_TYPE && pairRoot->type != NULL_TYPE) {
-        return evaluationError(); // Bindings should be a list
-    }
+    Frame *letFrame = makeFrame(frame, pairRoot, count);
     Object *body = cdr(cdr(tree));
+    gcPushRoot(&letFrame);
+    gcPushRoot(&pairRoot);
+    gcPushRoot(&body);
+    gcPushRoot(&frame);
 
     // Process each variable-value pair
-    while (pairRoot->type == CONS_TYPE) {
-        Object *pair = car(pairRoot);
-        if (pair->type != CONS_TYPE || cdr(pair)->type != CONS_TYPE) {
-            return evaluationError(); // Missing var or val
-        }
-
-        Object *var = car(pair);
-        Object *val = car(cdr(pair));
-        if (var->type != SYMBOL_TYPE) {
-            return evaluationError();
-        }
-
-        // Look for an existing binding in the current frame
-        Object *current = letFrame->bindings;
-        while (current->type != NULL_TYPE) {
-            Object *existingBinding = car(current);
-            if (strcmp(((Symbol *)car(existingBinding))->value, ((Symbol *)var)->value) == 0) {
-                return evaluationError(); // Duplicate variable found
-            }
-            current = cdr(current);
-        }
-
-        Object *value = eval(val, frame);
-        letFrame->bindings = cons(cons(var, value), letFrame->bindings);
-
+    for (int i = 0; i < count; i++) {
+        Object *var = car(car(pairRoot));
+        gcPushRoot(&var);
+        Object *value = eval(car(cdr(car(pairRoot))), frame);
+        gcPopRoots(1);
+        frameAddSlot(letFrame, var, value);
         pairRoot = cdr(pairRoot);
     }
-
-    if (pairRoot->type != NULL_TYPE) {
+    if (!valid) {
         return evaluationError();
     }
 
-    // Evaluate each expression in the body, returning the last result
+    // Evaluate each expression in the body but the last
     Object *result = NULL;
-    if (body->type == NULL_TYPE) {
+    if (body == NULL_OBJECT) {
         // No body expressions, return unspecified
-        result = talloc(sizeof(Object));
-        result->type = UNSPECIFIED_TYPE;
+        result = UNSPECIFIED_OBJECT;
     } 
     else {
-        while (body->type != NULL_TYPE) {
-            result = eval(car(body), letFrame);
-            body = cdr(body);
-        }
+        *treeSlot = evalBody(body, &letFrame);
+        *frameSlot = letFrame;
     }
+    gcPopRoots(4);
     return result;
 }
 
 // Helper function
 // Evaluate a quote expression
 Object *evalQuote(Object *tree) {
-    Object *list = cdr(tree);
-    if (list->type == NULL_TYPE || cdr(list)->type != NULL_TYPE) {
+    if (!checkQuote(tree)) {
         return evaluationError();
     }
-    return car(list);
+    return car(cdr(tree));
 }
 
 // Helper function
 // Evaluate a define expression
 Object *evalDefine(Object *tree, Frame *frame) {
-    // Check if there are exactly two arguments
-    if (cdr(tree)->type != CONS_TYPE || cdr(cdr(tree))->type != CONS_TYPE || cdr(cdr(cdr(tree)))->type != NULL_TYPE) {
+    if (!checkDefine(tree)) {
         return evaluationError();
     }
-
-    // Check if the first argument is a symbol
     Object *symbol = car(cdr(tree));
-    if (symbol->type != SYMBOL_TYPE) {
-        return evaluationError(); 
-    }
 
     // Check if the symbol already exists in the current frame
-    Object *current = frame->bindings;
-    while (current->type == CONS_TYPE) {
-        Object *binding = car(current);
-        if (strcmp(((Symbol *)car(binding))->value, ((Symbol *)symbol)->value) == 0) {
-            return evaluationError();
-        }
-        current = cdr(current);
+    if (frameLookup(frame, symbol) != NULL) {
+        return evaluationError();
     }
 
     Object *valueExpr = car(cdr(cdr(tree)));
+    gcPushRoot(&symbol);
+    gcPushRoot(&frame);
     Object *value = eval(valueExpr, frame);
-    Object *binding = cons(symbol, value);
-    frame->bindings = cons(binding, frame->bindings);
+    gcPopRoots(2);
+    frameBind(frame, symbol, value);
 
     // Return an object of VOID_TYPE as the result of define
-    Object *voidResult = talloc(sizeof(Object));
-    voidResult->type = VOID_TYPE;
-    return voidResult;
+    return VOID_OBJECT;
 }
 
 // Helper function
 // Evaluate a lambda expression
 Object *evalLambda(Object *tree, Frame *frame) {
-    Closure *closure = talloc(sizeof(Closure));
-    closure->type = CLOSURE_TYPE;
-    closure->frame = frame;
-
-    if (cdr(tree)->type != CONS_TYPE){
+    if (!checkLambda(tree)) {
         return evaluationError();
     }
+    Closure *closure = tallocPool(CLOSURE_POOL);
+    closure->type = CLOSURE_TYPE;
+    closure->frame = frame;
+    closure->code = NULL;
 
-    // Handle the list of parameters
     Object *paramList = car(cdr(tree));
-    if (paramList->type != CONS_TYPE && paramList->type != NULL_TYPE) {
-        return evaluationError();
-    }
-    
-    Object *currentParam = paramList;
-    while (currentParam->type == CONS_TYPE) {
-        Object *param = car(currentParam);
-        if (param->type != SYMBOL_TYPE) {
-            return evaluationError(); // Each parameter must be a symbol
-        }
-        currentParam = cdr(currentParam);
-    }
-    if (currentParam->type != NULL_TYPE) {
-        return evaluationError();
-    }
-
-    // Handle duplicate parameters
-    currentParam = paramList;
-    while (currentParam->type == CONS_TYPE) {
-        Object *check = cdr(currentParam);
-        while (check->type == CONS_TYPE) {
-            if (strcmp(((Symbol *)car(currentParam))->value, ((Symbol *)car(check))->value) == 0) {
-                return evaluationError(); // Duplicate parameter found
-            }
-            check = cdr(check);
-        }
-        currentParam = cdr(currentParam);
-    }
-
-    // Handle the body expressions
     Object *bodyList = cdr(cdr(tree));
-    if (bodyList->type == NULL_TYPE){
-        return evaluationError(); // Missing body expression
-    }
-
     closure->paramNames = paramList;
     closure->functionCode = bodyList;
 
@@ -233,40 +283,47 @@ Object *evalLambda(Object *tree, Frame *frame) {
 }
 
 // Helper function
-// Apply a closure to arguments
-Object *apply(Object *function, Object *args) {
+// Make the frame in which a closure runs, with its parameters bound to args
+Frame *bindArguments(Object *function, Object *args) {
     Closure *closure = (Closure *)function;
-    Frame *newFrame = talloc(sizeof(Frame));
-    newFrame->parent = closure->frame;
-    newFrame->bindings = makeNull();
+    int count = 0;
+    for (Object *current = closure->paramNames; typeOf(current) == CONS_TYPE; current = cdr(current)) {
+        count++;
+    }
+    Frame *newFrame = makeFrame(closure->frame, closure->paramNames, count);
 
     // Adding var val pairs to the binding of the new frame
     Object *paramList = closure->paramNames;
-    while (paramList->type == CONS_TYPE && args->type == CONS_TYPE) {
+    while (typeOf(paramList) == CONS_TYPE && typeOf(args) == CONS_TYPE) {
         Object *param = car(paramList);
         Object *argValue = car(args);
 
-        newFrame->bindings = cons(cons(param, argValue), newFrame->bindings);
+        frameAddSlot(newFrame, param, argValue);
         paramList = cdr(paramList);
         args = cdr(args);
     }
 
-    if (paramList->type != NULL_TYPE || args->type != NULL_TYPE) {
-        return evaluationError();
+    if (paramList != NULL_OBJECT || args != NULL_OBJECT) {
+        evaluationError();
     }
+    return newFrame;
+}
 
-    Object *body = closure->functionCode;
-    Object *result = NULL;
-    if (body->type == NULL_TYPE) {
-        result = talloc(sizeof(Object));
-        result->type = UNSPECIFIED_TYPE;
-    } else {
-        while (body->type != NULL_TYPE) {
-            result = eval(car(body), newFrame);
-            body = cdr(body);
-        }
+// Helper function
+// Apply a closure to arguments, for primitives such as map. Calls from Scheme
+// code go through evalApplication instead.
+Object *apply(Object *function, Object *args) {
+    Frame *newFrame = bindArguments(function, args);
+    if (engine == VM_ENGINE) {
+        return vmApply(function, newFrame);
     }
-
+    if (engine == NODE_ENGINE) {
+        return nodeApply(function, newFrame);
+    }
+    gcPushRoot(&newFrame);
+    Object *last = evalBody(((Closure *)function)->functionCode, &newFrame);
+    Object *result = eval(last, newFrame);
+    gcPopRoots(1);
     return result;
 }
 
@@ -283,29 +340,21 @@ Object *applyPrimitives(Object *function, Object *args) {
 // Helper function
 // Handle null? primitive
 Object *primitiveNull(Object *args) {
-    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+    if (typeOf(args) != CONS_TYPE || cdr(args) != NULL_OBJECT) {
         return evaluationError(); // Argument count is not 1
     }
     Object *arg = car(args);
-    Boolean *result = talloc(sizeof(Boolean));
-    result->type = BOOL_TYPE;
-    if (arg->type == NULL_TYPE){
-        result->value = 1;
-    }
-    else {
-        result->value = 0;
-    }
-    return (Object *)result;
+    return arg == NULL_OBJECT ? TRUE_OBJECT : FALSE_OBJECT;
 }
 
 // Helper function
 // Handle car primitive
 Object *primitiveCar(Object *args) {
-    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+    if (typeOf(args) != CONS_TYPE || cdr(args) != NULL_OBJECT) {
         return evaluationError(); // Error if argument count is not 1 or the type of the argument is not cons
     }
     Object *arg = car(args);
-    if (arg->type != CONS_TYPE) {
+    if (typeOf(arg) != CONS_TYPE) {
         return evaluationError(); // Error if argument is not a cons cell
     }
     return car(arg);
@@ -314,11 +363,11 @@ Object *primitiveCar(Object *args) {
 // Helper function
 // Handle cdr primitive
 Object *primitiveCdr(Object *args) {
-    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+    if (typeOf(args) != CONS_TYPE || cdr(args) != NULL_OBJECT) {
         return evaluationError(); // Error if argument count is not 1
     }
     Object *arg = car(args);
-    if (arg->type != CONS_TYPE) {
+    if (typeOf(arg) != CONS_TYPE) {
         return evaluationError(); // Error if argument is not a cons cell
     }
     return cdr(arg);
@@ -327,7 +376,7 @@ Object *primitiveCdr(Object *args) {
 // Helper function
 // Handle cons primitive
 Object *primitiveCons(Object *args) {
-    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE || cdr(cdr(args))->type != NULL_TYPE) {
+    if (typeOf(args) != CONS_TYPE || typeOf(cdr(args)) != CONS_TYPE || typeOf(cdr(cdr(args))) != NULL_TYPE) {
         return evaluationError(); // Argument count is not 2
     }
     Object *first = car(args);
@@ -340,11 +389,11 @@ Object *primitiveCons(Object *args) {
 Object *primitiveAdd(Object *args) {
     double sum = 0;
     int isdouble = 0; // 0 if the sum should be int, 1 if the sum should be double
-    while (args->type == CONS_TYPE) {
+    while (typeOf(args) == CONS_TYPE) {
         Object *arg = car(args);
-        if (arg->type == INT_TYPE) {
-            sum += ((Integer *)arg)->value;
-        } else if (arg->type == DOUBLE_TYPE) {
+        if (typeOf(arg) == INT_TYPE) {
+            sum += intValue(arg);
+        } else if (typeOf(arg) == DOUBLE_TYPE) {
             sum += ((Double *)arg)->value;
             isdouble = 1;
         } else {
@@ -354,14 +403,11 @@ Object *primitiveAdd(Object *args) {
     }
 
     if (isdouble == 0){
-        Integer *result = talloc(sizeof(Integer));
-        result->type = INT_TYPE;
         int sumInt = sum;
-        result->value = sumInt;
-        return (Object *)result;
+        return makeInteger(sumInt);
     }
     else if (isdouble == 1){
-        Double *result = talloc(sizeof(Double));
+        Double *result = tallocPool(DOUBLE_POOL);
         result->type = DOUBLE_TYPE;
         result->value = sum;
         return (Object *)result;
@@ -373,24 +419,27 @@ Object *primitiveAdd(Object *args) {
 // Helper function
 // Handle map primitive
 Object *primitiveMap(Object *args) {
-    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE || cdr(cdr(args))->type != NULL_TYPE) {
+    if (typeOf(args) != CONS_TYPE || typeOf(cdr(args)) != CONS_TYPE || typeOf(cdr(cdr(args))) != NULL_TYPE) {
         return evaluationError(); // Argument count is not 2
     }
     Object *func = car(args);
     Object *list = car(cdr(args));
-    if (list->type != CONS_TYPE && list->type != NULL_TYPE) {
+    if (typeOf(list) != CONS_TYPE && list != NULL_OBJECT) {
         return evaluationError(); // Second argument is not a list
     }
 
-    Object *result = makeNull();
-    while (list->type == CONS_TYPE) {
+    Object *result = NULL_OBJECT;
+    gcPushRoot(&func);
+    gcPushRoot(&list);
+    gcPushRoot(&result);
+    while (typeOf(list) == CONS_TYPE) {
         Object *element = car(list); 
-        Object *argList = cons(element, makeNull()); 
+        Object *argList = cons(element, NULL_OBJECT); 
 
         Object *mappedValue;
-        if (func->type == CLOSURE_TYPE) {
+        if (typeOf(func) == CLOSURE_TYPE) {
             mappedValue = apply(func, argList); 
-        } else if (func->type == PRIMITIVE_TYPE) {
+        } else if (typeOf(func) == PRIMITIVE_TYPE) {
             mappedValue = applyPrimitives(func, argList); 
         } else {
             return evaluationError(); // First argument is not a function
@@ -399,94 +448,171 @@ Object *primitiveMap(Object *args) {
         result = cons(mappedValue, result); 
         list = cdr(list); 
     }
+    gcPopRoots(3);
     
     result = reverse(result);
     return result;
 }
 
+// Helper function
+// Convert a statistic to an integer, saturating at the largest int
+Object *statValue(size_t value) {
+    return makeInteger(value > INT_MAX ? INT_MAX : (int)value);
+}
+
+// Helper function
+// Make the entry (name value...) of the memory-stats list
+Object *statEntry(char *name, Object *values) {
+    return cons((Object *)intern(name, strlen(name)), values);
+}
+
+// Helper function
+// Handle memory-stats primitive. Returns a list of (name value) entries for
+// the totals, followed by (type count bytes) for every type of object that
+// was allocated.
+Object *primitiveMemoryStats(Object *args) {
+    if (args != NULL_OBJECT) {
+        return evaluationError(); // Takes no arguments
+    }
+    TallocStats stats = tallocStats();
+    Object *result = NULL_OBJECT;
+    for (int i = NUM_TYPES - 1; i >= 0; i--) {
+        if (stats.objects[i] > 0) {
+            Object *values = cons(statValue(stats.objects[i]),
+                                  cons(statValue(stats.objectBytes[i]), NULL_OBJECT));
+            result = cons(statEntry((char *)typeName((objectType)i), values), result);
+        }
+    }
+    result = cons(statEntry("bytes-per-second", cons(statValue(stats.bytesPerSecond), NULL_OBJECT)), result);
+    result = cons(statEntry("peak-heap-bytes", cons(statValue(stats.peakHeapBytes), NULL_OBJECT)), result);
+    result = cons(statEntry("heap-bytes", cons(statValue(stats.heapBytes), NULL_OBJECT)), result);
+    result = cons(statEntry("total-bytes", cons(statValue(stats.totalBytes), NULL_OBJECT)), result);
+    return result;
+}
+
+// Helper function
+// Evaluate a function application. A primitive is applied right away. The
+// body of a closure is in tail position: its last expression and the frame of
+// the call are left in tree and frame for eval to go on with, and NULL is
+// returned.
+Object *evalApplication(Object **treeSlot, Frame **frameSlot) {
+    Object *tree = *treeSlot;
+    Frame *frame = *frameSlot;
+    Object *args = cdr(tree);
+    gcPushRoot(&args);
+    gcPushRoot(&frame);
+    Object *function = eval(car(tree), frame);
+    gcPushRoot(&function);
+
+    Object *evaluatedArgs = NULL_OBJECT;
+    gcPushRoot(&evaluatedArgs);
+    while (typeOf(args) == CONS_TYPE) {
+        Object *value = eval(car(args), frame);
+        evaluatedArgs = cons(value, evaluatedArgs);
+        args = cdr(args);
+    }
+    evaluatedArgs = reverse(evaluatedArgs);
+
+    // The arguments stay registered while the function runs, since
+    // primitives such as map call back into eval
+    Object *result = NULL;
+    if (typeOf(function) == PRIMITIVE_TYPE) {
+        result = applyPrimitives(function, evaluatedArgs);
+    }
+    else if (typeOf(function) == CLOSURE_TYPE) {
+        Frame *newFrame = bindArguments(function, evaluatedArgs);
+        gcPushRoot(&newFrame);
+        *treeSlot = evalBody(((Closure *)function)->functionCode, &newFrame);
+        *frameSlot = newFrame;
+        gcPopRoots(5);
+        return NULL;
+    }
+    else {
+        return evaluationError(); // Not a function
+    }
+    gcPopRoots(4);
+    return result;
+}
+
 // Input tree: A cons cell representing the root of the abstract syntax tree for 
 // a single Scheme expression (not an entire program).
 // Input frame: The frame, with respect to which to perform the evaluation.
 // Return: The value of the given expression with respect to the given frame.
 Object *eval(Object *tree, Frame *frame){
-    if (tree->type == INT_TYPE || tree->type == DOUBLE_TYPE || tree->type == STR_TYPE || tree->type == BOOL_TYPE){
-        return tree;
-    }
-    else if (tree->type == SYMBOL_TYPE){
-        return  evalSymbol(tree,frame);
-    }
-    else if (tree->type == CONS_TYPE){
-        Object *carCons = car(tree);
-        if (carCons->type == SYMBOL_TYPE && strcmp(((Symbol *)carCons)->value, "if") == 0) {
-            return evalIf(tree, frame);
-        }
-        else if (carCons->type == SYMBOL_TYPE && strcmp(((Symbol *)carCons)->value, "let") == 0) {
-            return evalLet(tree, frame);
-        }
-        else if (carCons->type == SYMBOL_TYPE && strcmp(((Symbol *)carCons)->value, "quote") == 0) {
-            return evalQuote(tree);
-        }
-        else if (carCons->type == SYMBOL_TYPE && strcmp(((Symbol *)carCons)->value, "define") == 0) {
-            return evalDefine(tree, frame);
-        }
-        else if (carCons->type == SYMBOL_TYPE && strcmp(((Symbol *)carCons)->value, "lambda") == 0) {
-            return evalLambda(tree, frame);
-        }
-        else {
-            // Assume it's a function application
-            Object *function = eval(carCons, frame);
-            Object *args = cdr(tree);
-
-            Object *evaluatedArgs = makeNull();
-            while (args->type == CONS_TYPE) {
-                evaluatedArgs = cons(eval(car(args), frame), evaluatedArgs);
-                args = cdr(args);
-            }
-            evaluatedArgs = reverse(evaluatedArgs);
-
-            if (function->type == PRIMITIVE_TYPE) {
-                return applyPrimitives(function, evaluatedArgs);
-            }
-            else if (function->type == CLOSURE_TYPE) {
-                return apply(function, evaluatedArgs);
-            }
+    // An expression in tail position (a branch of an if, the last expression
+    // of a let or of the body of a closure) is evaluated by going around this
+    // loop with a new tree and frame rather than by calling eval again, so
+    // that a loop written as tail recursion runs in constant C stack
+    gcPushRoot(&tree);
+    gcPushRoot(&frame);
+    Object *result = NULL;
+    while (result == NULL) {
+        // Safe point for the garbage collector
+        gcMaybeCollect();
+
+        switch (typeOf(tree)) {
+            case INT_TYPE:
+            case DOUBLE_TYPE:
+            case STR_TYPE:
+            case BOOL_TYPE:
+                result = tree;
+                break;
+            case LOCAL_TYPE:
+                result = evalLocal(tree, frame);
+                break;
+            case SYMBOL_TYPE:
+                result = evalSymbol(tree, frame);
+                break;
+            case CONS_TYPE:
+                switch (formOf(car(tree))) {
+                    case IF_FORM: result = evalIf(&tree, &frame); break;
+                    case LET_FORM: result = evalLet(&tree, &frame); break;
+                    case QUOTE_FORM: result = evalQuote(tree); break;
+                    case DEFINE_FORM: result = evalDefine(tree, frame); break;
+                    case LAMBDA_FORM: result = evalLambda(tree, frame); break;
+                    case NO_FORM: result = evalApplication(&tree, &frame); break;
+                }
+                break;
+            default:
+                result = evaluationError();
+                break;
         }
     }
-    return evaluationError();
+    gcPopRoots(2);
+    return result;
 }
 
 // Helper function to print an object's value
 void printObj(Object *obj) {
-    if (obj->type == INT_TYPE) {
-        printf("%d", ((Integer *)obj)->value);
+    if (typeOf(obj) == INT_TYPE) {
+        printf("%d", intValue(obj));
     } 
-    else if (obj->type == DOUBLE_TYPE) {
+    else if (typeOf(obj) == DOUBLE_TYPE) {
         printf("%f", ((Double *)obj)->value);
     } 
-    else if (obj->type == STR_TYPE) {
+    else if (typeOf(obj) == STR_TYPE) {
         printf("\"%s\"", ((String *)obj)->value);
     } 
-    else if (obj->type == SYMBOL_TYPE) {
+    else if (typeOf(obj) == SYMBOL_TYPE) {
         printf("%s", ((Symbol *)obj)->value);
     } 
-    else if (obj->type == BOOL_TYPE) {
-        Boolean *boolToken = (Boolean *)obj;
-        if (boolToken->value == 0) {
+    else if (typeOf(obj) == BOOL_TYPE) {
+        if (boolValue(obj) == 0) {
             printf("#f");
         } else {
             printf("#t");
         }
     } 
-    else if (obj->type == CONS_TYPE) {
+    else if (typeOf(obj) == CONS_TYPE) {
         printf("(");
         Object *current = obj;
-        while (current->type == CONS_TYPE) {
+        while (typeOf(current) == CONS_TYPE) {
             printObj(car(current));
             current = cdr(current);
-            if (current->type == CONS_TYPE) {
+            if (typeOf(current) == CONS_TYPE) {
                 printf(" ");
             }
-            else if (current->type != NULL_TYPE) {
+            else if (current != NULL_OBJECT) {
                 // Handle dotted pair
                 printf(" . ");
                 printObj(current);
@@ -494,16 +620,16 @@ void printObj(Object *obj) {
         }
         printf(")");
     } 
-    else if (obj->type == NULL_TYPE) {
+    else if (obj == NULL_OBJECT) {
         printf("()");
     } 
-    else if (obj->type == UNSPECIFIED_TYPE) {
+    else if (obj == UNSPECIFIED_OBJECT) {
         printf("#<unspecified>");
     } 
-    else if (obj->type == VOID_TYPE) {
+    else if (obj == VOID_OBJECT) {
         // Do nothing for VOID_TYPE
     } 
-    else if (obj->type == CLOSURE_TYPE) {
+    else if (typeOf(obj) == CLOSURE_TYPE) {
         printf("#<procedure>");
     } 
     else {
@@ -514,69 +640,145 @@ void printObj(Object *obj) {
 // Helper function
 // Add primitives to the global frame
 void addBinding(char *str, Primitive *primitive, Frame *frame){
-    Symbol *symbol = talloc(sizeof(Symbol));
-    symbol->type = SYMBOL_TYPE;
-    symbol->value = str;
+    Symbol *symbol = intern(str, strlen(str));
+    frameBind(frame, (Object *)symbol, (Object *)primitive);
+}
+
+// Every primitive and the name it is bound to in the global frame. Heap
+// images refer to a primitive by its position here (see primitiveFunction).
+static struct {
+    char *name;
+    PrimitiveFunction function;
+} primitives[] = {
+    {"null?", primitiveNull},
+    {"car", primitiveCar},
+    {"cdr", primitiveCdr},
+    {"cons", primitiveCons},
+    {"+", primitiveAdd},
+    {"map", primitiveMap},
+    {"memory-stats", primitiveMemoryStats},
+};
+
+// The frame that top-level expressions are evaluated in, or NULL until it is
+// needed (see globalEnvironment).
+static Frame *globalFrame = NULL;
+
+// Helper function
+// Marks the names of the special forms, so that eval recognizes them with a
+// switch on the form of the Symbol
+void internSpecialForms() {
+    intern("if", 2)->form = IF_FORM;
+    intern("let", 3)->form = LET_FORM;
+    intern("quote", 5)->form = QUOTE_FORM;
+    intern("define", 6)->form = DEFINE_FORM;
+    intern("lambda", 6)->form = LAMBDA_FORM;
+}
 
-    Object *binding = cons((Object *)symbol,(Object *)primitive);
+// Helper function
+// Make the global frame with all primitives bound in it
+Frame *makeGlobalFrame() {
+    Frame *frame = makeFrame(NULL, NULL_OBJECT, 0); // No parent frame for global scope
+    internSpecialForms();
+
+    for (size_t i = 0; i < sizeof(primitives) / sizeof(primitives[0]); i++) {
+        Primitive *primitive = tallocObject(PRIMITIVE_TYPE, sizeof(Primitive));
+        primitive->type = PRIMITIVE_TYPE;
+        primitive->pf = primitives[i].function;
+        addBinding(primitives[i].name, primitive, frame);
+    }
+    return frame;
+}
+
+// Input index: A position in the table of primitives, starting at 0.
+// Return: The function of the primitive at that position, or NULL if there
+// are fewer primitives.
+PrimitiveFunction primitiveFunction(int index) {
+    if (index < 0 || index >= (int)(sizeof(primitives) / sizeof(primitives[0]))) {
+        return NULL;
+    }
+    return primitives[index].function;
+}
+
+// Return: The frame that top-level expressions are evaluated in. The first
+// call makes it, with all primitives bound in it, unless one was given to
+// setGlobalEnvironment before.
+Frame *globalEnvironment() {
+    if (globalFrame == NULL) {
+        globalFrame = makeGlobalFrame();
+    }
+    return globalFrame;
+}
+
+// Input frame: A global frame, such as the one of a heap image.
+// Makes frame the frame that top-level expressions are evaluated in. Must be
+// called before anything is evaluated.
+void setGlobalEnvironment(Frame *frame) {
+    globalFrame = frame;
+    internSpecialForms();
+}
 
-    frame->bindings = cons(binding, frame->bindings);
+// Input engine: The engine that interpret and interpretStream use. The
+// default is AST_ENGINE.
+void setEngine(Engine newEngine) {
+    engine = newEngine;
+}
+
+// Helper function
+// Evaluate a top-level expression in the global frame with the chosen engine
+Object *evalTopLevel(Object *tree) {
+    tree = resolve(tree);
+    if (engine == VM_ENGINE) {
+        return vmEval(tree, globalFrame);
+    }
+    if (engine == NODE_ENGINE) {
+        return nodeEval(tree, globalFrame);
+    }
+    return eval(tree, globalFrame);
 }
 
 // Input tree: A cons cell representing the root of the abstract syntax tree for 
 // a Scheme program (which may contain multiple expressions).
 // Evaluates the program, printing the result of each expression in it.
 void interpret(Object *tree) {
-    Frame *globalFrame = talloc(sizeof(Frame));
-    globalFrame->parent = NULL; // No parent frame for global scope
-    globalFrame->bindings = makeNull();
-
-    // null?
-    Primitive *primNull = talloc(sizeof(Primitive));
-    primNull->type = PRIMITIVE_TYPE;
-    primNull->pf = primitiveNull;
-    char *nullString = "null?";
-    addBinding(nullString, primNull, globalFrame);
-
-    // car
-    Primitive *primCar = talloc(sizeof(Primitive));
-    primCar->type = PRIMITIVE_TYPE;
-    primCar->pf = primitiveCar;
-    char *carString = "car";
-    addBinding(carString, primCar, globalFrame);
-
-    // cdr
-    Primitive *primCdr = talloc(sizeof(Primitive));
-    primCdr->type = PRIMITIVE_TYPE;
-    primCdr->pf = primitiveCdr;
-    char *cdrString = "cdr";
-    addBinding(cdrString, primCdr, globalFrame);
-
-    // cons
-    Primitive *primCons = talloc(sizeof(Primitive));
-    primCons->type = PRIMITIVE_TYPE;
-    primCons->pf = primitiveCons;
-    char *consString = "cons";
-    addBinding(consString, primCons, globalFrame);
-
-    // +
-    Primitive *primAdd = talloc(sizeof(Primitive));
-    primAdd->type = PRIMITIVE_TYPE;
-    primAdd->pf = primitiveAdd;
-    char *addString = "+";
-    addBinding(addString, primAdd, globalFrame);
-
-    // map
-    Primitive *primMap = talloc(sizeof(Primitive));
-    primMap->type = PRIMITIVE_TYPE;
-    primMap->pf = primitiveMap;
-    char *mapString = "map";
-    addBinding(mapString, primMap, globalFrame);
-
-    while (tree->type != NULL_TYPE) {
-        Object *result = eval(car(tree), globalFrame);
+    globalEnvironment();
+
+    // The rest of the program and the global frame are the roots of every
+    // garbage collection
+    gcPushRoot(&tree);
+    gcPushRoot(&globalFrame);
+    while (tree != NULL_OBJECT) {
+        gcBeginRegion();
+        Object *result = evalTopLevel(car(tree));
         printObj(result);
         printf("\n");
         tree = cdr(tree);
+        gcEndRegion();
+    }
+    gcPopRoots(2);
+}
+
+// Input tokenizer: Where to read a Scheme program from.
+// Evaluates the program one expression at a time, printing the result of each
+// expression as soon as the expression has been read. Nothing is kept of an
+// expression once it has been evaluated, so memory does not grow with the
+// length of the program.
+void interpretStream(Tokenizer *tokenizer) {
+    globalEnvironment();
+    Parser parser;
+    parserInit(&parser, tokenizer);
+
+    // The expression being evaluated and the global frame are the roots of
+    // every garbage collection
+    Object *tree = NULL;
+    gcPushRoot(&tree);
+    gcPushRoot(&globalFrame);
+    while ((tree = parseNext(&parser)) != NULL) {
+        gcBeginRegion();
+        Object *result = evalTopLevel(tree);
+        printObj(result);
+        printf("\n");
+        gcEndRegion();
     }
+    gcPopRoots(2);
+    parserClose(&parser);
 }
\ No newline at end of file
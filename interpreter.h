@@ -5,6 +5,22 @@
 #define _INTERPRETER
 
 #include "object.h"
+#include "tokenizer.h"
+
+// The C function behind a primitive (see Primitive).
+typedef Object *(*PrimitiveFunction)(Object *);
+
+// The ways interpret can run a program: by walking the abstract syntax tree
+// with eval, by compiling each top-level expression to bytecode for the
+// virtual machine (see vm.h), or by compiling it to a tree of nodes that call
+// each other (see nodes.h). All print the same output.
+typedef enum {
+    AST_ENGINE, VM_ENGINE, NODE_ENGINE
+} Engine;
+
+// Input engine: The engine that interpret and interpretStream use. The
+// default is AST_ENGINE.
+void setEngine(Engine engine);
 
 // Input tree: A cons cell representing the root of the abstract syntax tree for 
 // a single Scheme expression (not an entire program).
@@ -12,11 +28,77 @@
 // Return: The value of the given expression with respect to the given frame.
 Object *eval(Object *tree, Frame *frame);
 
+// Prints that the evaluation failed and exits.
+// Return: Never returns; the return type lets callers write
+// return evaluationError().
+Object *evaluationError();
+
+// The syntax checks of the special forms, which eval and the compilers of
+// bytecode.c and nodes.c share, so that all engines turn down the same
+// programs. Whether a symbol is bound already is not syntax, and is left to
+// each engine.
+
+// Input tree: An if expression.
+// Return: True if it has a condition, a then branch and at most an else
+// branch.
+bool checkIf(Object *tree);
+
+// Input tree: A let expression.
+// Input count: Where to store how many bindings come before the first one
+// that is wrong, or all of them if none is. Their values are computed before
+// a let with a wrong binding fails.
+// Return: True if the bindings are a proper list of (symbol value) pairs with
+// no symbol twice. The body is not checked.
+bool checkLet(Object *tree, int *count);
+
+// Input tree: A quote expression.
+// Return: True if it quotes exactly one expression.
+bool checkQuote(Object *tree);
+
+// Input tree: A define expression.
+// Return: True if it has a symbol and one expression for its value.
+bool checkDefine(Object *tree);
+
+// Input tree: A lambda expression.
+// Return: True if its parameters are a proper list of symbols with no symbol
+// twice, and it has a body.
+bool checkLambda(Object *tree);
+
 // Input tree: A cons cell representing the root of the abstract syntax tree for 
 // a Scheme program (which may contain multiple expressions).
 // Evaluates the program, printing the result of each expression in it.
 void interpret(Object *tree);
 
+// Input tokenizer: Where to read a Scheme program from.
+// Evaluates the program one expression at a time, printing the result of each
+// expression as soon as the expression has been read. Nothing is kept of an
+// expression once it has been evaluated, so memory does not grow with the
+// length of the program.
+void interpretStream(Tokenizer *tokenizer);
+
+// Return: The frame that top-level expressions are evaluated in. The first
+// call makes it, with all primitives bound in it, unless one was given to
+// setGlobalEnvironment before.
+Frame *globalEnvironment();
+
+// Input frame: A global frame, such as the one of a heap image.
+// Makes frame the frame that top-level expressions are evaluated in. Must be
+// called before anything is evaluated.
+void setGlobalEnvironment(Frame *frame);
+
+// Input index: A position in the table of primitives, starting at 0.
+// Return: The function of the primitive at that position, or NULL if there
+// are fewer primitives.
+PrimitiveFunction primitiveFunction(int index);
+
+// Input args: The arguments of a call of null?, car, cdr or +, as a list.
+// Return: The value of the call. The JIT (see jit.h) recognizes these
+// primitives by their functions and inlines the common cases.
+Object *primitiveNull(Object *args);
+Object *primitiveCar(Object *args);
+Object *primitiveCdr(Object *args);
+Object *primitiveAdd(Object *args);
+
 #endif
 
 
@@ -0,0 +1,475 @@
+// jit.c by Leon Liang
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "frame.h"
+#include "bytecode.h"
+#include "nodes.h"
+#include "interpreter.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// How many times a tree runs before it is compiled, or 0 for never
+static uint32_t threshold = 0;
+
+// Input calls: How many times the tree of a body runs before it is compiled
+// to machine code. 0, the default, turns the compiler off.
+void jitSetThreshold(uint32_t calls){
+    threshold = calls;
+}
+
+#ifdef JIT_SUPPORTED
+
+// The machine code keeps the values it has computed but not used yet, such
+// as the arguments of a call, in this stack, where the collector sees them.
+// It never moves, so the code can address it directly. Each call of compiled
+// code takes as many entries as it needs and clears them on entry.
+#define JIT_STACK_SIZE (1 << 20)
+
+static Object **stack = NULL;
+static size_t stackDepth = 0;
+
+// Machine code that is being generated
+typedef struct Assembler {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    uint32_t temps;             // entries of the stack in use
+    uint32_t maxTemps;          // the most entries ever in use
+} Assembler;
+
+// The registers the templates use, numbered as in the instruction encoding
+typedef enum {
+    RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7
+} Register;
+
+// Helper function
+// Append n bytes of machine code
+static void emit(Assembler *a, const void *bytes, size_t n){
+    if (a->length + n > a->capacity) {
+        a->capacity = a->capacity == 0 ? 256 : 2 * a->capacity + n;
+        a->bytes = realloc(a->bytes, a->capacity);
+        if (a->bytes == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+    }
+    memcpy(a->bytes + a->length, bytes, n);
+    a->length += n;
+}
+
+#define EMIT(a, s) emit(a, s, sizeof(s) - 1)
+
+// Helper function
+// Append a 32-bit operand
+static void emit32(Assembler *a, uint32_t value){
+    emit(a, &value, 4);
+}
+
+// Helper function
+// Append a 64-bit operand
+static void emit64(Assembler *a, uint64_t value){
+    emit(a, &value, 8);
+}
+
+// Helper function
+// mov reg, value
+static void loadImmediate(Assembler *a, Register reg, const void *value){
+    uint8_t bytes[2] = {0x48, 0xb8 + reg};
+    emit(a, bytes, 2);
+    emit64(a, (uintptr_t)value);
+}
+
+// Helper function
+// call function; the arguments are in rdi, rsi, rdx and rcx
+static void callFunction(Assembler *a, const void *function){
+    loadImmediate(a, RAX, function);
+    EMIT(a, "\xff\xd0");                        // call rax
+}
+
+// Helper function
+// Input opcode: A jump with a 32-bit displacement, such as "\x0f\x84" (je).
+// Return: Where the displacement is, for patch.
+static size_t jump(Assembler *a, const char *opcode){
+    emit(a, opcode, strlen(opcode));
+    emit32(a, 0);
+    return a->length - 4;
+}
+
+// Helper function
+// Make the jump whose displacement is at position land here
+static void patch(Assembler *a, size_t position){
+    uint32_t displacement = a->length - (position + 4);
+    memcpy(a->bytes + position, &displacement, 4);
+}
+
+// Helper function
+// Return a new entry of the stack, in use until a->temps is set back
+static uint32_t newTemp(Assembler *a){
+    uint32_t temp = a->temps++;
+    if (a->temps > a->maxTemps) {
+        a->maxTemps = a->temps;
+    }
+    return temp;
+}
+
+// Helper function
+// mov rax, [r12 + 8 * temp]
+static void loadTemp(Assembler *a, uint32_t temp){
+    EMIT(a, "\x49\x8b\x84\x24");
+    emit32(a, 8 * temp);
+}
+
+// Helper function
+// mov [r12 + 8 * temp], rax
+static void storeTemp(Assembler *a, uint32_t temp){
+    EMIT(a, "\x49\x89\x84\x24");
+    emit32(a, 8 * temp);
+}
+
+// Helper function
+// lea reg, [r12 + 8 * temp]
+static void addressOfTemp(Assembler *a, Register reg, uint32_t temp){
+    uint8_t bytes[4] = {0x49, 0x8d, 0x84 | reg << 3, 0x24};
+    emit(a, bytes, 4);
+    emit32(a, 8 * temp);
+}
+
+// Helper function
+// Load the current frame into rax. The frame is in the variable rbx points
+// to, or in entry frame of the stack if frame is not -1.
+static void loadFrame(Assembler *a, int frame){
+    if (frame < 0) {
+        EMIT(a, "\x48\x8b\x03");                // mov rax, [rbx]
+    }
+    else {
+        loadTemp(a, frame);
+    }
+}
+
+// Helper function
+// Run node with its interpreter function, for nodes without a template
+static void compileFallback(Assembler *a, Node *node, int frame){
+    loadImmediate(a, RDI, node);
+    if (frame < 0) {
+        EMIT(a, "\x48\x89\xde");                // mov rsi, rbx
+    }
+    else {
+        addressOfTemp(a, RSI, frame);
+    }
+    callFunction(a, node->run);
+}
+
+// Helper function
+// Make the frame of a let, like runLet, with the values of its bindings
+// computed already
+static Frame *makeLetFrame(Frame *parent, Object *pairs, Object **values, uint32_t count){
+    Frame *frame = makeFrame(parent, pairs, count);
+    for (uint32_t i = 0; i < count; i++) {
+        frameAddSlot(frame, car(car(pairs)), values[i]);
+        pairs = cdr(pairs);
+    }
+    return frame;
+}
+
+// Helper function
+// Input node: A call.
+// Return: The primitive the function of node is bound to in the global frame
+// right now, if it is one whose common cases have a template and node passes
+// it a number of arguments it takes; NULL otherwise.
+static Primitive *inlinePrimitive(Node *node){
+    if (node->children[0]->kind != LOOKUP_NODE) {
+        return NULL;
+    }
+    Object **value = frameLookup(globalEnvironment(), node->children[0]->value);
+    if (value == NULL || typeOf(*value) != PRIMITIVE_TYPE) {
+        return NULL;
+    }
+    Primitive *primitive = (Primitive *)*value;
+    uint32_t argCount = node->count - 1;
+    if (primitive->pf == primitiveAdd) {
+        return primitive;
+    }
+    if (primitive->pf == primitiveNull || primitive->pf == primitiveCar || primitive->pf == primitiveCdr) {
+        return argCount == 1 ? primitive : NULL;
+    }
+    return NULL;
+}
+
+static void compileNode(Assembler *a, Node *node, int frame);
+
+// Helper function
+// Compile a call. The function and the arguments go into entries of the
+// stack, and nodeCall makes the call. If the function is a variable bound to
+// a primitive with a template, the template runs instead as long as the
+// variable is still bound to it and the arguments are what it handles:
+// fixnums whose sum fits in an int for +, a pair for car and cdr.
+static void compileCall(Assembler *a, Node *node, int frame){
+    uint32_t base = a->temps;
+    for (uint32_t i = 0; i < node->count; i++) {
+        compileNode(a, node->children[i], frame);
+        storeTemp(a, newTemp(a));
+    }
+
+    Primitive *primitive = inlinePrimitive(node);
+    size_t done = 0;
+    size_t *slow = malloc((node->count + 1) * sizeof(size_t));
+    if (slow == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    size_t slowCount = 0;
+    if (primitive != NULL) {
+        loadTemp(a, base);
+        loadImmediate(a, RCX, primitive);
+        EMIT(a, "\x48\x39\xc8");                // cmp rax, rcx
+        slow[slowCount++] = jump(a, "\x0f\x85"); // jne slow
+        if (primitive->pf == primitiveAdd) {
+            EMIT(a, "\x31\xd2");                // xor edx, edx
+            for (uint32_t i = 1; i < node->count; i++) {
+                loadTemp(a, base + i);
+                EMIT(a, "\x89\xc1");            // mov ecx, eax
+                EMIT(a, "\x83\xe1\x07");        // and ecx, TAG_MASK
+                EMIT(a, "\x83\xf9\x01");        // cmp ecx, FIXNUM_TAG
+                slow[slowCount++] = jump(a, "\x0f\x85");
+                EMIT(a, "\x48\xc1\xf8\x03");    // sar rax, TAG_BITS
+                EMIT(a, "\x48\x63\xc0");        // movsxd rax, eax (intValue)
+                EMIT(a, "\x48\x01\xc2");        // add rdx, rax
+            }
+            EMIT(a, "\x48\x63\xc2");            // movsxd rax, edx
+            EMIT(a, "\x48\x39\xd0");            // cmp rax, rdx
+            slow[slowCount++] = jump(a, "\x0f\x85");
+            EMIT(a, "\x48\x8d\x04\xc5\x01\x00\x00\x00"); // lea rax, [rax * 8 + 1]
+        }
+        else if (primitive->pf == primitiveNull) {
+            loadTemp(a, base + 1);
+            loadImmediate(a, RCX, NULL_OBJECT);
+            loadImmediate(a, RDX, TRUE_OBJECT);
+            EMIT(a, "\x48\x39\xc8");            // cmp rax, rcx
+            loadImmediate(a, RAX, FALSE_OBJECT);
+            EMIT(a, "\x48\x0f\x44\xc2");        // cmove rax, rdx
+        }
+        else {
+            loadTemp(a, base + 1);
+            EMIT(a, "\x89\xc1");                // mov ecx, eax
+            EMIT(a, "\x83\xe1\x07");            // and ecx, TAG_MASK
+            EMIT(a, "\x83\xf9\x03");            // cmp ecx, CONS_TAG
+            slow[slowCount++] = jump(a, "\x0f\x85");
+            if (primitive->pf == primitiveCar) {
+                EMIT(a, "\x48\x8b\x40\xfd");    // mov rax, [rax - CONS_TAG]
+            }
+            else {
+                EMIT(a, "\x48\x8b\x40\x05");    // mov rax, [rax - CONS_TAG + 8]
+            }
+        }
+        done = jump(a, "\xe9");                 // jmp done
+    }
+
+    for (size_t i = 0; i < slowCount; i++) {
+        patch(a, slow[i]);
+    }
+    free(slow);
+    addressOfTemp(a, RDI, base);
+    EMIT(a, "\xbe");                            // mov esi, argCount
+    emit32(a, node->count - 1);
+    EMIT(a, "\xba");                            // mov edx, tail
+    emit32(a, node->kind == TAIL_CALL_NODE);
+    callFunction(a, nodeCall);
+    if (primitive != NULL) {
+        patch(a, done);
+    }
+    a->temps = base;
+}
+
+// Helper function
+// Compile a let. The values of the bindings go into entries of the stack,
+// and so does the frame made from them, for the body to run in.
+static void compileLet(Assembler *a, Node *node, int frame){
+    uint32_t base = a->temps;
+    for (uint32_t i = 0; i < node->slot; i++) {
+        compileNode(a, node->children[i], frame);
+        storeTemp(a, newTemp(a));
+    }
+    loadFrame(a, frame);
+    EMIT(a, "\x48\x89\xc7");                    // mov rdi, rax
+    loadImmediate(a, RAX, &node->code->constants[node->index]);
+    EMIT(a, "\x48\x8b\x30");                    // mov rsi, [rax]
+    addressOfTemp(a, RDX, base);
+    EMIT(a, "\xb9");                            // mov ecx, count
+    emit32(a, node->slot);
+    callFunction(a, makeLetFrame);
+    uint32_t letFrame = newTemp(a);
+    storeTemp(a, letFrame);
+    for (uint32_t i = node->slot; i < node->count; i++) {
+        compileNode(a, node->children[i], letFrame);
+    }
+    a->temps = base;
+}
+
+// Helper function
+// Input a: Where to append the template.
+// Input node: A node of the tree.
+// Input frame: Where the frame to run node in is (see loadFrame).
+// Appends machine code that leaves the value of node in rax.
+static void compileNode(Assembler *a, Node *node, int frame){
+    switch (node->kind) {
+        case VALUE_NODE:
+            loadImmediate(a, RAX, node->value);
+            break;
+        case CONSTANT_NODE:
+            // The constant may move, so it is loaded each time
+            loadImmediate(a, RAX, &node->code->constants[node->index]);
+            EMIT(a, "\x48\x8b\x00");            // mov rax, [rax]
+            break;
+        case LOCAL_NODE:
+            loadFrame(a, frame);
+            for (uint32_t depth = node->index; depth > 0; depth--) {
+                EMIT(a, "\x48\x8b\x80");        // mov rax, [rax + parent]
+                emit32(a, offsetof(Frame, parent));
+            }
+            EMIT(a, "\x48\x8b\x80");            // mov rax, [rax + slot]
+            emit32(a, offsetof(Frame, slots) + node->slot * sizeof(Object *));
+            break;
+        case SEQUENCE_NODE:
+            for (uint32_t i = 0; i < node->count; i++) {
+                compileNode(a, node->children[i], frame);
+            }
+            break;
+        case IF_NODE: {
+            compileNode(a, node->children[0], frame);
+            loadImmediate(a, RCX, FALSE_OBJECT);
+            EMIT(a, "\x48\x39\xc8");            // cmp rax, rcx
+            size_t otherwise = jump(a, "\x0f\x84"); // je otherwise
+            compileNode(a, node->children[1], frame);
+            size_t end = jump(a, "\xe9");       // jmp end
+            patch(a, otherwise);
+            compileNode(a, node->children[2], frame);
+            patch(a, end);
+            break;
+        }
+        case LET_NODE:
+            compileLet(a, node, frame);
+            break;
+        case CALL_NODE:
+        case TAIL_CALL_NODE:
+            compileCall(a, node, frame);
+            break;
+        default:
+            compileFallback(a, node, frame);
+            break;
+    }
+}
+
+// Helper function
+// Input code: Code of the node engine.
+// Compiles the tree of code to machine code and makes it run that from now
+// on. The code is a function like the one of the root node; it runs the
+// root node's own function instead when the stack is full.
+static void jitCompile(Code *code){
+    if (stack == NULL) {
+        stack = malloc(JIT_STACK_SIZE * sizeof(Object *));
+        if (stack == NULL) {
+            return;
+        }
+        gcAddRootArray(&stack, &stackDepth);
+    }
+
+    Assembler body = {NULL, 0, 0, 0, 0};
+    compileNode(&body, code->node, -1);
+    uint32_t temps = body.maxTemps;
+
+    Assembler a = {NULL, 0, 0, 0, 0};
+    EMIT(&a, "\x53");                           // push rbx
+    EMIT(&a, "\x41\x54");                       // push r12
+    EMIT(&a, "\x41\x55");                       // push r13
+    EMIT(&a, "\x48\x89\xf3");                   // mov rbx, rsi
+    EMIT(&a, "\x49\xbd");                       // mov r13, &stackDepth
+    emit64(&a, (uintptr_t)&stackDepth);
+    EMIT(&a, "\x4d\x8b\x65\x00");               // mov r12, [r13]
+    EMIT(&a, "\x49\x8d\x84\x24");               // lea rax, [r12 + temps]
+    emit32(&a, temps);
+    EMIT(&a, "\x48\x3d");                       // cmp rax, JIT_STACK_SIZE
+    emit32(&a, JIT_STACK_SIZE);
+    size_t full = jump(&a, "\x0f\x87");         // ja full
+    EMIT(&a, "\x49\x89\x45\x00");               // mov [r13], rax
+    loadImmediate(&a, RAX, stack);
+    EMIT(&a, "\x4e\x8d\x24\xe0");               // lea r12, [rax + r12 * 8]
+    EMIT(&a, "\x31\xc0");                       // xor eax, eax
+    for (uint32_t i = 0; i < temps; i++) {
+        storeTemp(&a, i);
+    }
+    emit(&a, body.bytes, body.length);
+    free(body.bytes);
+    EMIT(&a, "\x49\x81\x6d\x00");               // sub qword [r13], temps
+    emit32(&a, temps);
+    EMIT(&a, "\x41\x5d\x41\x5c\x5b\xc3");       // pop r13; pop r12; pop rbx; ret
+    patch(&a, full);
+    loadImmediate(&a, RDI, code->node);
+    EMIT(&a, "\x48\x89\xde");                   // mov rsi, rbx
+    callFunction(&a, code->node->run);
+    EMIT(&a, "\x41\x5d\x41\x5c\x5b\xc3");       // pop r13; pop r12; pop rbx; ret
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (a.length + page - 1) / page * page;
+    void *native = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (native == MAP_FAILED) {
+        free(a.bytes);
+        return; // The tree stays interpreted
+    }
+    memcpy(native, a.bytes, a.length);
+    free(a.bytes);
+    if (mprotect(native, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(native, size);
+        return;
+    }
+    code->native = native;
+    code->nativeSize = size;
+    code->node->run = (NodeFunction)native;
+}
+
+// Input code: Code of the node engine that is about to run.
+// Counts the run, and compiles the tree of code to machine code once it has
+// run as often as the threshold says. From then on the tree runs as machine
+// code.
+void jitCountCall(Code *code){
+    if (code->calls < threshold && ++code->calls == threshold) {
+        jitCompile(code);
+    }
+}
+
+// Input code: Code that is being freed.
+// Frees the machine code of code, if it has any.
+void jitFree(Code *code){
+    if (code->native != NULL) {
+        munmap(code->native, code->nativeSize);
+    }
+}
+
+#else
+
+// Input code: Code of the node engine that is about to run.
+// There is no compiler for this machine, so the tree stays interpreted.
+void jitCountCall(Code *code){
+    (void)code;
+}
+
+// Input code: Code that is being freed.
+// There is never any machine code to free on this machine.
+void jitFree(Code *code){
+    (void)code;
+}
+
+#endif
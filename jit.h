@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include "bytecode.h"
+
+#ifndef _JIT
+#define _JIT
+
+// A baseline compiler from trees of nodes (see nodes.h) to x86-64 machine
+// code. Each kind of node has a fixed template of instructions, and nodes it
+// has no template for are run by calling their interpreter function, so the
+// machine code of a body computes exactly what its tree would. On other
+// machines nothing is compiled and the trees are interpreted as before.
+
+// Input calls: How many times the tree of a body runs before it is compiled
+// to machine code. 0, the default, turns the compiler off.
+void jitSetThreshold(uint32_t calls);
+
+// Input code: Code of the node engine that is about to run.
+// Counts the run, and compiles the tree of code to machine code once it has
+// run as often as the threshold says. From then on the tree runs as machine
+// code.
+void jitCountCall(Code *code);
+
+// Input code: Code that is being freed.
+// Frees the machine code of code, if it has any.
+void jitFree(Code *code);
+
+#endif
@@ -3,72 +3,74 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <limits.h>
 #include "object.h"
 #include "linkedlist.h"
 #include "talloc.h"
 #include <stdio.h>
 
-// Return: A newly allocated Object of NULL_TYPE.
+// Return: The Object of NULL_TYPE. It is an immediate, so nothing is allocated.
 Object *makeNull(){
-    Object *nullObj = (Object *)talloc(sizeof(Object));
-    nullObj->type = NULL_TYPE;
-    return (Object *)nullObj;
+    return NULL_OBJECT;
 }
 
-// Return: A newly allocated Object of INT_TYPE.
-Integer *makeInt(){
-    Integer *intObj = (Integer *)talloc(sizeof(Integer));
+// Input value: Any int.
+// Return: An Object of INT_TYPE with that value. It is a fixnum whenever the
+// value fits in one, and a newly allocated Integer otherwise.
+Object *makeInteger(int value){
+    // An int always fits in a fixnum when int is narrower than a pointer
+#if INT_MAX <= FIXNUM_MAX
+    return makeFixnum(value);
+#else
+    if (value >= FIXNUM_MIN && value <= FIXNUM_MAX) {
+        return makeFixnum(value);
+    }
+    Integer *intObj = (Integer *)tallocPool(INT_POOL);
     intObj->type = INT_TYPE;
-    return (Integer *)intObj;
+    intObj->value = value;
+    return (Object *)intObj;
+#endif
 }
 
 // Return: A newly allocated Object of DOUBLE_TYPE.
 Double *makeDouble(){
-    Double *doubleObj = (Double *)talloc(sizeof(Double));
+    Double *doubleObj = (Double *)tallocPool(DOUBLE_POOL);
     doubleObj->type = DOUBLE_TYPE;
     return (Double *)doubleObj;
 }
 
 // Return: A newly allocated Object of STR_TYPE.
 String *makeString(){
-    String *strObj = (String *)talloc(sizeof(String));
+    String *strObj = (String *)tallocObject(STR_TYPE, sizeof(String));
     strObj->type = STR_TYPE;
     return (String *)strObj;
 }
 
-// Return: A newly allocated Object of CONS_TYPE.
-ConsCell *makeConsCell(){
-    ConsCell *conObj = (ConsCell *)talloc(sizeof(ConsCell));
-    conObj->type = CONS_TYPE;
-    return (ConsCell *)conObj;
-}
-
 // Input newCar: An instance of Object or one of its subclasses.
 // Input newCdr: An instance of Object or one of its subclasses.
 // Return: A newly allocated ConsCell object with that car and cdr.
 Object *cons(Object *newCar, Object *newCdr){
-    ConsCell *newObj = (ConsCell *)talloc(sizeof(ConsCell));
-    newObj->type = CONS_TYPE;
+    ConsCell *newObj = (ConsCell *)tallocPool(CONS_POOL);
     newObj->car = newCar;
     newObj->cdr = newCdr;
-    return (Object *)newObj;
+    return tagCons(newObj);
 }
 
 // Input list: A ConsCell that is the head of a list.
 // Prints the entire list in a human-readable way.
 void display(Object *list) {
-    if (list->type == NULL_TYPE) {
+    if (list == NULL_OBJECT) {
         printf("()");
         return;
     }
     
     printf("(");
-    while (list->type != NULL_TYPE) {
-        assert(list->type == CONS_TYPE);
+    while (list != NULL_OBJECT) {
+        assert(typeOf(list) == CONS_TYPE);
 
-        objectType type = car(list)->type;
+        objectType type = typeOf(car(list));
         if (type == INT_TYPE) {
-            printf("%d", ((Integer *)car(list))->value);
+            printf("%d", intValue(car(list)));
         } else if (type == DOUBLE_TYPE) {
             printf("%f", ((Double *)car(list))->value);
         } else if (type == STR_TYPE) {
@@ -78,7 +80,7 @@ void display(Object *list) {
         }
 
         list = cdr(list);
-        if (list->type != NULL_TYPE) {
+        if (list != NULL_OBJECT) {
             printf(" ");
         }
     }
@@ -90,8 +92,8 @@ void display(Object *list) {
 // the given list. All content within the list is duplicated; there is no shared 
 // memory whatsoever between the given list and the new one.
 Object *reverse(Object *list) {
-    Object *rlist = makeNull();
-    while (list->type != NULL_TYPE) {
+    Object *rlist = NULL_OBJECT;
+    while (list != NULL_OBJECT) {
         rlist = cons(car(list),rlist);
         list = cdr(list);
     }
@@ -103,8 +105,8 @@ Object *reverse(Object *list) {
 // This is a convenience function to slightly accelerate taking cars of objects 
 // known to be cons cells.
 Object *car(Object *list){
-    assert (list->type == CONS_TYPE);
-    return ((ConsCell *)list)->car;
+    assert (isCons(list));
+    return consCell(list)->car;
 }
 
 // Input list: A ConsCell.
@@ -112,14 +114,14 @@ Object *car(Object *list){
 // This is a convenience function to slightly accelerate taking cars of objects 
 // known to be cons cells.
 Object *cdr(Object *list){
-    assert (list->type == CONS_TYPE);
-    return ((ConsCell *)list)->cdr;
+    assert (isCons(list));
+    return consCell(list)->cdr;
 }
 
 // Input list: Any object.
 // Return: A Boolean indicating whether that object is of NULL_TYPE.
 bool isNull(Object *value){
-    return (value->type == NULL_TYPE);
+    return (value == NULL_OBJECT);
 }
 
 // Input value: A ConsCell that is the head of a list.
@@ -127,8 +129,8 @@ bool isNull(Object *value){
 // and the Scheme list (7) has length 1.
 int length(Object *value){
     int count = 0;
-    while (value->type != NULL_TYPE) {
-        assert (CONS_TYPE == value->type);
+    while (value != NULL_OBJECT) {
+        assert (CONS_TYPE == typeOf(value));
         assert (value != NULL);
         count++;
         value = cdr(value);
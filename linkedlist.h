@@ -6,9 +6,14 @@
 #ifndef _LINKEDLIST
 #define _LINKEDLIST
 
-// Return: A newly allocated Object of NULL_TYPE.
+// Return: The Object of NULL_TYPE. It is an immediate, so nothing is allocated.
 Object *makeNull();
 
+// Input value: Any int.
+// Return: An Object of INT_TYPE with that value. It is a fixnum whenever the
+// value fits in one, and a newly allocated Integer otherwise.
+Object *makeInteger(int value);
+
 // Input newCar: An instance of Object or one of its subclasses.
 // Input newCdr: An instance of Object or one of its subclasses.
 // Return: A newly allocated ConsCell object with that car and cdr.
@@ -1,17 +1,152 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
 #include "tokenizer.h"
 #include "object.h"
 #include "linkedlist.h"
 #include "parser.h"
 #include "talloc.h"
 #include "interpreter.h"
+#include "gc.h"
+#include "parallel.h"
+#include "cache.h"
+#include "image.h"
+#include "jit.h"
 
-int main() {
+// Prints the command line options to stderr.
+void usage(char *name) {
+    fprintf(stderr, "Usage: %s [options] [program.scm]\n", name);
+    fprintf(stderr, "Reads the program from standard input if no file is given.\n");
+    fprintf(stderr, "  --nursery=BYTES     size of the young generation; 0 disables it\n");
+    fprintf(stderr, "  --stream            evaluate each expression as soon as it is read\n");
+    fprintf(stderr, "  --engine=ast|vm|nodes  walk the syntax tree (default), run bytecode,\n");
+    fprintf(stderr, "                      or run a tree of precompiled nodes\n");
+    fprintf(stderr, "  --jit[=CALLS]       run nodes, compiling a body to x86-64 machine code\n");
+    fprintf(stderr, "                      once it has run CALLS times (default: 100)\n");
+    fprintf(stderr, "  --parallel[=N]      parse large programs on N threads (default: all cores)\n");
+    fprintf(stderr, "  --ast-cache         keep the parsed program in program.scm.ast for later runs\n");
+    fprintf(stderr, "  --image=FILE        start from the global environment saved in FILE\n");
+    fprintf(stderr, "  --dump-image=FILE   save the global environment to FILE at exit\n");
+    fprintf(stderr, "  --region            evaluate each top-level form in its own region\n");
+    fprintf(stderr, "  --gc-threshold=BYTES[,PERCENT]  collect once the heap holds BYTES\n");
+    fprintf(stderr, "                      (default: 4 MB), then once it grows to PERCENT\n");
+    fprintf(stderr, "                      of what survived (default: 200)\n");
+    fprintf(stderr, "  --heap-limit=BYTES  stop with an error once the heap needs more memory\n");
+    fprintf(stderr, "  --gc-stats          print garbage collection statistics at exit\n");
+    fprintf(stderr, "  --mem-stats         print allocation statistics at exit\n");
+}
+
+int main(int argc, char **argv) {
+    bool printStats = false;
+    bool printMemoryStats = false;
+    bool stream = false;
+    int threads = 1;
+    bool cache = false;
+    char *image = NULL;
+    char *dump = NULL;
+    char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--nursery=", 10) == 0) {
+            gcSetNurserySize(strtoul(argv[i] + 10, NULL, 10));
+        }
+        else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
+        }
+        else if (strcmp(argv[i], "--engine=ast") == 0) {
+            setEngine(AST_ENGINE);
+        }
+        else if (strcmp(argv[i], "--engine=vm") == 0) {
+            setEngine(VM_ENGINE);
+        }
+        else if (strcmp(argv[i], "--engine=nodes") == 0) {
+            setEngine(NODE_ENGINE);
+        }
+        else if (strcmp(argv[i], "--jit") == 0) {
+            setEngine(NODE_ENGINE);
+            jitSetThreshold(100);
+        }
+        else if (strncmp(argv[i], "--jit=", 6) == 0) {
+            setEngine(NODE_ENGINE);
+            jitSetThreshold(strtoul(argv[i] + 6, NULL, 10));
+        }
+        else if (strcmp(argv[i], "--parallel") == 0) {
+            threads = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+            threads = atoi(argv[i] + 11);
+        }
+        else if (strcmp(argv[i], "--ast-cache") == 0) {
+            cache = true;
+        }
+        else if (strncmp(argv[i], "--image=", 8) == 0) {
+            image = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--dump-image=", 13) == 0) {
+            dump = argv[i] + 13;
+        }
+        else if (strcmp(argv[i], "--region") == 0) {
+            gcSetRegionMode(true);
+        }
+        else if (strncmp(argv[i], "--gc-threshold=", 15) == 0) {
+            char *end;
+            size_t bytes = strtoul(argv[i] + 15, &end, 10);
+            gcSetThreshold(bytes, *end == ',' ? atoi(end + 1) : 0);
+        }
+        else if (strncmp(argv[i], "--heap-limit=", 13) == 0) {
+            gcSetHeapLimit(strtoul(argv[i] + 13, NULL, 10));
+        }
+        else if (strcmp(argv[i], "--gc-stats") == 0) {
+            printStats = true;
+        }
+        else if (strcmp(argv[i], "--mem-stats") == 0) {
+            printMemoryStats = true;
+        }
+        else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
-    Object *list = tokenize();
-    Object *tree = parse(list);
-    interpret(tree);
+    if (image != NULL) {
+        loadImage(image);
+    }
+    if (stream) {
+        Tokenizer *tokenizer = tokenizerOpen(path);
+        interpretStream(tokenizer);
+        tokenizerClose(tokenizer);
+    }
+    else if (threads > 1 || (cache && path != NULL)) {
+        Source source;
+        readSource(&source, path);
+        Object *tree;
+        if (cache && path != NULL) {
+            tree = parseCached(path, source.text, source.length, threads);
+        }
+        else {
+            tree = parseParallel(source.text, source.length, threads);
+        }
+        closeSource(&source);
+        interpret(tree);
+    }
+    else {
+        Object *tree = parseAll(tokenizerOpen(path));
+        interpret(tree);
+    }
 
+    if (dump != NULL) {
+        dumpImage(dump);
+    }
+    if (printStats) {
+        gcPrintStats();
+    }
+    if (printMemoryStats) {
+        tallocPrintStats();
+    }
     tfree();
     return 0;
 }
@@ -0,0 +1,559 @@
+// nodes.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "frame.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "nodes.h"
+#include "jit.h"
+
+// What a call in tail position returns instead of a value. The call leaves
+// the code and frame of the callee here, and runBody, further down the C
+// stack, goes on with them, so that a loop written as tail recursion runs in
+// constant C stack. Nothing runs between the call and runBody that could
+// collect.
+static Object tailCall;
+#define TAIL_CALL (&tailCall)
+
+static Code *pendingCode = NULL;
+static Frame *pendingFrame = NULL;
+static Object *pendingClosure = NULL;
+
+static Code *compileFunction(Object *params, Object *body);
+
+// Helper function
+// Return the code of the body of closure, which is compiled on the first call
+static Code *closureNodes(Closure *closure){
+    if (closure->code == NULL) {
+        closure->code = compileFunction(closure->paramNames, closure->functionCode);
+    }
+    return closure->code;
+}
+
+// Helper function
+// Input code: Code whose node is the body of closure, or a top-level
+// expression.
+// Input frame: The frame to run it in.
+// Input closure: The closure, or NULL.
+// Return: The value of the body, once it is not a tail call anymore.
+static Object *runBody(Code *code, Frame *frame, Object *closure){
+    gcPushRoot(&frame);
+    gcPushRoot(&closure);
+    Object *result;
+    for (;;) {
+        // Safe point for the garbage collector
+        gcMaybeCollect();
+        jitCountCall(code);
+        result = code->node->run(code->node, &frame);
+        if (result != TAIL_CALL) {
+            break;
+        }
+        code = pendingCode;
+        frame = pendingFrame;
+        closure = pendingClosure;
+    }
+    gcPopRoots(2);
+    return result;
+}
+
+// Helper function
+// Return the immediate or Symbol of the node
+static Object *runValue(Node *node, Frame **frame){
+    (void)frame;
+    return node->value;
+}
+
+// Helper function
+// Return a constant that may move, such as a quoted list
+static Object *runConstant(Node *node, Frame **frame){
+    (void)frame;
+    return node->code->constants[node->index];
+}
+
+// Helper function
+// Look up a local variable of the current frame
+static Object *runLocal0(Node *node, Frame **frame){
+    return (*frame)->slots[node->slot];
+}
+
+// Helper function
+// Look up a local variable of the frame the current frame is nested in
+static Object *runLocal1(Node *node, Frame **frame){
+    return (*frame)->parent->slots[node->slot];
+}
+
+// Helper function
+// Look up a local variable any number of frames up
+static Object *runLocal(Node *node, Frame **frame){
+    Frame *current = *frame;
+    for (uint32_t depth = node->index; depth > 0; depth--) {
+        current = current->parent;
+    }
+    return current->slots[node->slot];
+}
+
+// Helper function
+// Look up a Symbol by name, like evalSymbol
+static Object *runLookup(Node *node, Frame **frame){
+    for (Frame *current = *frame; current != NULL; current = current->parent) {
+        Object **value = frameLookup(current, node->value);
+        if (value != NULL) {
+            return *value;
+        }
+    }
+    return evaluationError();
+}
+
+// Helper function
+// Report a syntax error, once the expression that has it is run
+static Object *runError(Node *node, Frame **frame){
+    (void)node;
+    (void)frame;
+    return evaluationError();
+}
+
+// Helper function
+// Run each child, returning the value of the last
+static Object *runSequence(Node *node, Frame **frame){
+    uint32_t last = node->count - 1;
+    for (uint32_t i = 0; i < last; i++) {
+        node->children[i]->run(node->children[i], frame);
+    }
+    return node->children[last]->run(node->children[last], frame);
+}
+
+// Helper function
+// Run the condition, then one of the branches (children 0, 1 and 2)
+static Object *runIf(Node *node, Frame **frame){
+    Object *condition = node->children[0]->run(node->children[0], frame);
+    Node *branch = node->children[condition != FALSE_OBJECT ? 1 : 2];
+    return branch->run(branch, frame);
+}
+
+// Helper function
+// Run a let: the first slot children are the values of the bindings in
+// constant index, the rest is the body
+static Object *runLet(Node *node, Frame **frame){
+    Object *pairs = node->code->constants[node->index];
+    Frame *letFrame = makeFrame(*frame, pairs, node->slot);
+    gcPushRoot(&letFrame);
+    gcPushRoot(&pairs);
+    for (uint32_t i = 0; i < node->slot; i++) {
+        Object *value = node->children[i]->run(node->children[i], frame);
+        frameAddSlot(letFrame, car(car(pairs)), value);
+        pairs = cdr(pairs);
+    }
+    uint32_t last = node->count - 1;
+    for (uint32_t i = node->slot; i < last; i++) {
+        node->children[i]->run(node->children[i], &letFrame);
+    }
+    Object *result = node->children[last]->run(node->children[last], &letFrame);
+    gcPopRoots(2);
+    return result;
+}
+
+// Helper function
+// Run a define of the Symbol of the node, like evalDefine
+static Object *runDefine(Node *node, Frame **frame){
+    if (frameLookup(*frame, node->value) != NULL) {
+        return evaluationError();
+    }
+    Object *value = node->children[0]->run(node->children[0], frame);
+    frameBind(*frame, node->value, value);
+    return VOID_OBJECT;
+}
+
+// Helper function
+// Make a closure of the lambda of the node, whose parameters and body are
+// constants index and slot
+static Object *runLambda(Node *node, Frame **frame){
+    Closure *closure = tallocPool(CLOSURE_POOL);
+    closure->type = CLOSURE_TYPE;
+    closure->paramNames = node->code->constants[node->index];
+    closure->functionCode = node->code->constants[node->slot];
+    closure->frame = *frame;
+    closure->code = node->lambda;
+    return (Object *)closure;
+}
+
+// Helper function
+// Input node: A call; child 0 is the function, the rest are the arguments.
+// Input frame: The frame to run it in.
+// Input tail: Whether the call is in tail position.
+// Return: The value of the call, or TAIL_CALL. The arguments of a closure
+// go straight into the slots of its frame as they are computed.
+static Object *call(Node *node, Frame **frame, bool tail){
+    uint32_t argCount = node->count - 1;
+    Object *function = node->children[0]->run(node->children[0], frame);
+    gcPushRoot(&function);
+
+    if (typeOf(function) == CLOSURE_TYPE) {
+        Closure *closure = (Closure *)function;
+        Code *code = closureNodes(closure);
+        if (code->paramCount == (int)argCount) {
+            Frame *callFrame = makeFrame(closure->frame, closure->paramNames, argCount);
+            Object *param = closure->paramNames;
+            gcPushRoot(&callFrame);
+            gcPushRoot(&param);
+            for (uint32_t i = 1; i <= argCount; i++) {
+                Object *value = node->children[i]->run(node->children[i], frame);
+                frameAddSlot(callFrame, car(param), value);
+                param = cdr(param);
+            }
+            gcPopRoots(3);
+            if (tail) {
+                pendingCode = code;
+                pendingFrame = callFrame;
+                pendingClosure = function;
+                return TAIL_CALL;
+            }
+            return runBody(code, callFrame, function);
+        }
+    }
+
+    // A primitive gets its arguments as a list, like in evalApplication
+    Object *args = NULL_OBJECT;
+    gcPushRoot(&args);
+    for (uint32_t i = 1; i <= argCount; i++) {
+        Object *value = node->children[i]->run(node->children[i], frame);
+        args = cons(value, args);
+    }
+    args = reverse(args);
+    if (typeOf(function) != PRIMITIVE_TYPE) {
+        return evaluationError(); // Not a function, or the wrong number of arguments
+    }
+    Object *result = ((Primitive *)function)->pf(args);
+    gcPopRoots(2);
+    return result;
+}
+
+// Input values: The function of a call, followed by its arguments, in memory
+// the collector sees (such as the stack of jit.c).
+// Input argCount: The number of arguments.
+// Input tail: Whether the call is in tail position.
+// Return: The value of the call, or, for a closure in tail position, the
+// marker that has runBody make the call once the node returns it.
+Object *nodeCall(Object **values, uint32_t argCount, bool tail){
+    Object *function = values[0];
+    if (typeOf(function) == CLOSURE_TYPE) {
+        Closure *closure = (Closure *)function;
+        Code *code = closureNodes(closure);
+        if (code->paramCount == (int)argCount) {
+            Frame *callFrame = makeFrame(closure->frame, closure->paramNames, argCount);
+            Object *param = closure->paramNames;
+            for (uint32_t i = 1; i <= argCount; i++) {
+                frameAddSlot(callFrame, car(param), values[i]);
+                param = cdr(param);
+            }
+            if (tail) {
+                pendingCode = code;
+                pendingFrame = callFrame;
+                pendingClosure = function;
+                return TAIL_CALL;
+            }
+            return runBody(code, callFrame, function);
+        }
+    }
+    if (typeOf(function) != PRIMITIVE_TYPE) {
+        return evaluationError(); // Not a function, or the wrong number of arguments
+    }
+    Object *args = NULL_OBJECT;
+    for (uint32_t i = argCount; i > 0; i--) {
+        args = cons(values[i], args);
+    }
+    gcPushRoot(&args);
+    Object *result = ((Primitive *)function)->pf(args);
+    gcPopRoots(1);
+    return result;
+}
+
+// Helper function
+// Run a call that is not in tail position
+static Object *runCall(Node *node, Frame **frame){
+    return call(node, frame, false);
+}
+
+// Helper function
+// Run a call in tail position
+static Object *runTailCall(Node *node, Frame **frame){
+    return call(node, frame, true);
+}
+
+// Helper function
+// Input code: The code the node belongs to.
+// Input kind: What the node does.
+// Input run: The function that does it.
+// Input count: The number of children.
+// Return: A new node, freed along with code.
+static Node *newNode(Code *code, NodeKind kind, NodeFunction run, uint32_t count){
+    Node *node = calloc(1, sizeof(Node) + count * sizeof(Node *));
+    if (node == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    node->run = run;
+    node->kind = kind;
+    node->code = code;
+    node->count = count;
+    node->next = code->nodes;
+    code->nodes = node;
+    return node;
+}
+
+// Helper function
+// Make a node that returns obj
+static Node *compileConstant(Code *code, Object *obj){
+    if (isImmediate(obj) || typeOf(obj) == SYMBOL_TYPE) {
+        Node *node = newNode(code, VALUE_NODE, runValue, 0);
+        node->value = obj;
+        return node;
+    }
+    Node *node = newNode(code, CONSTANT_NODE, runConstant, 0);
+    node->index = codeConstant(code, obj);
+    return node;
+}
+
+// Helper function
+// Make a node that reports a syntax error
+static Node *compileError(Code *code){
+    return newNode(code, ERROR_NODE, runError, 0);
+}
+
+static Node *compileNode(Code *code, Object *tree, bool tail);
+
+// Helper function
+// Input code: The code the nodes belong to.
+// Input body: A list of expressions.
+// Input tail: Whether the last expression is in tail position.
+// Return: A node that runs the expressions in order and returns the value of
+// the last. Like evalBody, a body that is not a proper list fails
+// once it gets to the end.
+static Node *compileSequence(Code *code, Object *body, bool tail){
+    uint32_t count = 0;
+    Object *current = body;
+    for (; isCons(current); current = cdr(current)) {
+        count++;
+    }
+    bool proper = current == NULL_OBJECT && body != NULL_OBJECT;
+    if (!proper) {
+        count++;
+    }
+    if (count == 1 && proper) {
+        return compileNode(code, car(body), tail);
+    }
+    Node *node = newNode(code, SEQUENCE_NODE, runSequence, count);
+    uint32_t i = 0;
+    for (current = body; isCons(current); current = cdr(current)) {
+        bool last = proper && cdr(current) == NULL_OBJECT;
+        node->children[i++] = compileNode(code, car(current), tail && last);
+    }
+    if (!proper) {
+        node->children[i++] = compileError(code);
+    }
+    return node;
+}
+
+// Helper function
+// Compile an if expression, checked with checkIf
+static Node *compileIf(Code *code, Object *tree, bool tail){
+    if (!checkIf(tree)) {
+        return compileError(code);
+    }
+    Object *conditionCons = cdr(tree);
+    Object *thenCons = cdr(conditionCons);
+    Object *elseCons = cdr(thenCons);
+    Node *node = newNode(code, IF_NODE, runIf, 3);
+    node->children[0] = compileNode(code, car(conditionCons), false);
+    node->children[1] = compileNode(code, car(thenCons), tail);
+    if (isCons(elseCons)) {
+        node->children[2] = compileNode(code, car(elseCons), tail);
+    }
+    else {
+        node->children[2] = compileConstant(code, UNSPECIFIED_OBJECT);
+    }
+    return node;
+}
+
+// Helper function
+// Compile a let expression, checked with checkLet. A let with a bad binding
+// computes the values before it in the frame around the let, then fails, as
+// evalLet would.
+static Node *compileLet(Code *code, Object *tree, bool tail){
+    int count;
+    bool valid = checkLet(tree, &count);
+    if (!valid && count == 0) {
+        return compileError(code);
+    }
+    Object *pairRoot = car(cdr(tree));
+    Object *current = pairRoot;
+    if (!valid) {
+        Node *node = newNode(code, SEQUENCE_NODE, runSequence, count + 1);
+        for (int i = 0; i < count; i++, current = cdr(current)) {
+            node->children[i] = compileNode(code, car(cdr(car(current))), false);
+        }
+        node->children[count] = compileError(code);
+        return node;
+    }
+
+    Object *body = cdr(cdr(tree));
+    uint32_t bodyCount = 0;
+    for (current = body; isCons(current); current = cdr(current)) {
+        bodyCount++;
+    }
+    bool proper = current == NULL_OBJECT;
+    Node *node = newNode(code, LET_NODE, runLet, count + (bodyCount == 0 ? 1 : bodyCount) + !proper);
+    node->index = codeConstant(code, pairRoot);
+    node->slot = count;
+    current = pairRoot;
+    for (int i = 0; i < count; i++, current = cdr(current)) {
+        node->children[i] = compileNode(code, car(cdr(car(current))), false);
+    }
+    uint32_t i = count;
+    if (body == NULL_OBJECT) {
+        node->children[i++] = compileConstant(code, UNSPECIFIED_OBJECT);
+    }
+    for (current = body; isCons(current); current = cdr(current)) {
+        bool last = proper && cdr(current) == NULL_OBJECT;
+        node->children[i++] = compileNode(code, car(current), tail && last);
+    }
+    if (!proper) {
+        node->children[i++] = compileError(code);
+    }
+    return node;
+}
+
+// Helper function
+// Compile a quote expression, checked with checkQuote
+static Node *compileQuote(Code *code, Object *tree){
+    if (!checkQuote(tree)) {
+        return compileError(code);
+    }
+    return compileConstant(code, car(cdr(tree)));
+}
+
+// Helper function
+// Compile a define expression, checked with checkDefine
+static Node *compileDefine(Code *code, Object *tree){
+    if (!checkDefine(tree)) {
+        return compileError(code);
+    }
+    Object *symbol = car(cdr(tree));
+    Node *node = newNode(code, DEFINE_NODE, runDefine, 1);
+    node->value = symbol;
+    node->children[0] = compileNode(code, car(cdr(cdr(tree))), false);
+    return node;
+}
+
+// Helper function
+// Compile a lambda expression, checked with checkLambda. The body gets code
+// of its own.
+static Node *compileLambda(Code *code, Object *tree){
+    if (!checkLambda(tree)) {
+        return compileError(code);
+    }
+    Object *paramList = car(cdr(tree));
+    Object *bodyList = cdr(cdr(tree));
+    Node *node = newNode(code, LAMBDA_NODE, runLambda, 0);
+    node->index = codeConstant(code, paramList);
+    node->slot = codeConstant(code, bodyList);
+    node->lambda = compileFunction(paramList, bodyList);
+    return node;
+}
+
+// Helper function
+// Compile a function application
+static Node *compileApplication(Code *code, Object *tree, bool tail){
+    uint32_t count = 1;
+    for (Object *args = cdr(tree); isCons(args); args = cdr(args)) {
+        count++;
+    }
+    Node *node = newNode(code, tail ? TAIL_CALL_NODE : CALL_NODE, tail ? runTailCall : runCall, count);
+    node->children[0] = compileNode(code, car(tree), false);
+    uint32_t i = 1;
+    for (Object *args = cdr(tree); isCons(args); args = cdr(args)) {
+        node->children[i++] = compileNode(code, car(args), false);
+    }
+    return node;
+}
+
+// Helper function
+// Input code: The code the node belongs to.
+// Input tree: An expression, resolved (see resolve.h).
+// Input tail: Whether the value of tree is the value of the whole body. A call
+// there returns TAIL_CALL instead of calling.
+// Return: The node for tree.
+static Node *compileNode(Code *code, Object *tree, bool tail){
+    switch (typeOf(tree)) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+            return compileConstant(code, tree);
+        case LOCAL_TYPE: {
+            uintptr_t depth = localDepth(tree);
+            Node *node = newNode(code, LOCAL_NODE, depth == 0 ? runLocal0 : depth == 1 ? runLocal1 : runLocal, 0);
+            node->index = depth;
+            node->slot = localSlot(tree);
+            return node;
+        }
+        case SYMBOL_TYPE: {
+            Node *node = newNode(code, LOOKUP_NODE, runLookup, 0);
+            node->value = tree;
+            return node;
+        }
+        case CONS_TYPE:
+            switch (formOf(car(tree))) {
+                case IF_FORM: return compileIf(code, tree, tail);
+                case LET_FORM: return compileLet(code, tree, tail);
+                case QUOTE_FORM: return compileQuote(code, tree);
+                case DEFINE_FORM: return compileDefine(code, tree);
+                case LAMBDA_FORM: return compileLambda(code, tree);
+                case NO_FORM: return compileApplication(code, tree, tail);
+            }
+            break;
+        default:
+            break;
+    }
+    return compileError(code);
+}
+
+// Helper function
+// Input params: The parameter list of a lambda, already checked.
+// Input body: Its body.
+// Return: The code of the body, which the collector owns from now on (see
+// gcTrackCode).
+static Code *compileFunction(Object *params, Object *body){
+    Code *code = codeNew(body, params);
+    code->node = compileSequence(code, body, true);
+    gcTrackCode(code);
+    return code;
+}
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Input frame: The frame to evaluate it in.
+// Return: The value of tree, as eval would compute it. The expression is
+// compiled to nodes first. Syntax errors are found then, once, but turned into
+// nodes that report them when they are run.
+Object *nodeEval(Object *tree, Frame *frame){
+    Code *code = codeNew(NULL, NULL_OBJECT);
+    code->node = compileNode(code, tree, true);
+    gcAddRootArray(&code->constants, &code->constantCount);
+    Object *result = runBody(code, frame, NULL);
+    gcRemoveRootArray(&code->constants);
+    codeFree(code);
+    return result;
+}
+
+// Input function: A closure.
+// Input frame: A frame for a call of function, with the arguments bound to
+// its parameters.
+// Return: The value of the body of function in frame. Used by primitives such
+// as map, which call closures with arguments of their own.
+Object *nodeApply(Object *function, Frame *frame){
+    return runBody(closureNodes((Closure *)function), frame, function);
+}
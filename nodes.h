@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include "object.h"
+#include "bytecode.h"
+
+#ifndef _NODES
+#define _NODES
+
+// An expression compiled to a tree of nodes. Each node carries the C function
+// that does what its kind of expression does (e.g. fetch the local variable in
+// slot 2 of the current frame, or call a function with three arguments),
+// picked once when the expression is compiled, along with what that function
+// needs. Running the tree is then a chain of indirect calls, without looking
+// at the syntax again.
+typedef struct Node Node;
+
+// What a node does, for the compiler to machine code (see jit.h)
+typedef enum {
+    VALUE_NODE,         // value
+    CONSTANT_NODE,      // constant index of the code
+    LOCAL_NODE,         // the local variable in slot of the frame index up
+    LOOKUP_NODE,        // the Symbol value, looked up by name
+    ERROR_NODE,         // a syntax error
+    SEQUENCE_NODE,      // the children in order
+    IF_NODE,            // children 0, then 1 or 2
+    LET_NODE,           // slot values for the bindings in constant index,
+                        // then the body
+    DEFINE_NODE,        // bind value to child 0
+    LAMBDA_NODE,        // a closure of constants index and slot and lambda
+    CALL_NODE,          // child 0 applied to the other children
+    TAIL_CALL_NODE      // the same, in tail position
+} NodeKind;
+
+// Input node: The node to run.
+// Input frame: The address of a variable registered with the collector (see
+// gcPushRoot) that holds the frame to run the node in.
+// Return: The value of the node.
+typedef Object *(*NodeFunction)(Node *node, Frame **frame);
+
+struct Node {
+    NodeFunction run;
+    NodeKind kind;
+    Node *next;                 // the next node of the same code, for codeFree
+    Code *code;                 // the code whose constants the node uses
+    Object *value;              // an immediate, or a Symbol, which never moves
+    uint32_t index;             // a constant of the code, or the depth of a local
+    uint32_t slot;              // the slot of a local, or another constant
+    Code *lambda;               // the code of the body of a lambda
+    uint32_t count;             // the number of children
+    Node *children[];
+};
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Input frame: The frame to evaluate it in.
+// Return: The value of tree, as eval would compute it. The expression is
+// compiled to nodes first. Syntax errors are found then, once, but turned into
+// nodes that report them when they are run.
+Object *nodeEval(Object *tree, Frame *frame);
+
+// Input values: The function of a call, followed by its arguments, in memory
+// the collector sees (such as the stack of jit.c).
+// Input argCount: The number of arguments.
+// Input tail: Whether the call is in tail position.
+// Return: The value of the call, or, for a closure in tail position, the
+// marker that has runBody make the call once the node returns it.
+Object *nodeCall(Object **values, uint32_t argCount, bool tail);
+
+// Input function: A closure.
+// Input frame: A frame for a call of function, with the arguments bound to
+// its parameters.
+// Return: The value of the body of function in frame. Used by primitives such
+// as map, which call closures with arguments of their own.
+Object *nodeApply(Object *function, Frame *frame);
+
+#endif
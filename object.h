@@ -4,10 +4,14 @@
 #ifndef _VALUE
 #define _VALUE
 
+#include <stdint.h>
+#include <stdbool.h>
+
 typedef enum {
     INT_TYPE, DOUBLE_TYPE, STR_TYPE, CONS_TYPE, NULL_TYPE, PTR_TYPE,
     OPEN_TYPE, CLOSE_TYPE, BOOL_TYPE, SYMBOL_TYPE, CLOSEBRACE_TYPE, 
-    UNSPECIFIED_TYPE, VOID_TYPE, CLOSURE_TYPE, PRIMITIVE_TYPE
+    UNSPECIFIED_TYPE, VOID_TYPE, CLOSURE_TYPE, PRIMITIVE_TYPE, FRAME_TYPE,
+    FORWARD_TYPE, LOCAL_TYPE, NUM_TYPES
 } objectType;
 
 // An Object can have a few types --- any type that requires no extra storage.
@@ -15,7 +19,8 @@ typedef struct Object {
     objectType type;
 } Object;
 
-// An Integer should have INT_TYPE.
+// An Integer should have INT_TYPE. Integers normally are fixnums (see below);
+// this boxed form is only used for values that do not fit in a fixnum.
 typedef struct Integer {
     objectType type;
     int value;
@@ -41,40 +46,69 @@ typedef struct Pointer {
     void *value;
 } Pointer;
 
-// A ConsCell should have CONS_TYPE.
+// A ConsCell has CONS_TYPE, but unlike the other objects it does not store its
+// type. Instead, an Object * that points to a ConsCell carries CONS_TAG in its
+// low bits (see below), which keeps a cell at 16 bytes. Use consCell to get
+// from such an Object * to the fields.
 typedef struct ConsCell {
-    objectType type;
     Object *car;
     Object *cdr;
 } ConsCell;
 
-// A Boolean should have BOOL_TYPE. The value should be 0 for false, 1 for true.
-typedef struct Boolean {
-    objectType type;
-    int value;
-} Boolean;
+// The special forms that eval knows. The Symbol that names one carries it in
+// its form member, so that eval can dispatch on it with a switch.
+typedef enum {
+    NO_FORM, IF_FORM, LET_FORM, QUOTE_FORM, DEFINE_FORM, LAMBDA_FORM
+} specialForm;
 
 // A Symbol should have SYMBOL_TYPE. Its value member should point to a heap-
 // allocated C string. As always, that string should be null-terminated.
 typedef struct Symbol {
     objectType type;
+    specialForm form;       // NO_FORM unless the interpreter assigned one
     char *value;
 } Symbol;
 
-// A frame is a list of bindings and a pointer to a parent frame. The details of 
-// how the bindings are stored are up to you. Just be consistent.
+// A frame is an array of slots, a list of bindings and a pointer to a parent
+// frame. The slots hold the values of the parameters of a lambda or the
+// variables of a let, in order; names is the parameter list or the list of
+// let bindings they come from. Bindings made by define go into the list.
+// A Frame should have FRAME_TYPE, so that the garbage collector can tell it
+// apart from the other objects it traces. Its size depends on capacity (see
+// tpoolForFrame).
+// A frame with many bindings also indexes them in a table (see frame.h).
+#define FRAME_SLOTS_MAX 8
+
 struct Frame {
+    objectType type;
+    uint16_t count;             // slots filled so far
+    uint16_t capacity;          // slots allocated, at most FRAME_SLOTS_MAX
     Object *bindings;
     struct Frame *parent;
+    struct FrameTable *table;   // NULL until the frame is big enough
+    Object *names;
+    Object *slots[];
 };
 typedef struct Frame Frame;
 
-// A Closure should have CLOSURE_TYPE.
+// A Forward has FORWARD_TYPE. The garbage collector overwrites a young object
+// with a Forward once it has moved the object out of the nursery. A young
+// ConsCell, which has no type field, is forwarded by storing the immediate
+// FORWARD_TYPE in its car and the new cell in its cdr instead.
+typedef struct Forward {
+    objectType type;
+    Object *to;
+} Forward;
+
+// A Closure should have CLOSURE_TYPE. Its body is compiled to bytecode the
+// first time the virtual machine calls it (see bytecode.h); code is NULL until
+// then.
 struct Closure {
     objectType type;
     Object *paramNames;
     Object *functionCode;
     Frame *frame;
+    struct Code *code;
 };
 typedef struct Closure Closure;
 
@@ -85,6 +119,188 @@ struct Primitive {
 } ;
 typedef struct Primitive Primitive;
 
+// An Object * is a tagged word. Heap objects are aligned to 8 bytes, so the
+// low three bits of a real pointer are free to say what it points to:
+//   ...address 000               any heap object other than a ConsCell
+//   ...address 011               a ConsCell
+// Anything else is an immediate that carries its whole value in the word and
+// is never allocated:
+//   ...value 001                 a fixnum, i.e. an Integer
+//   ...payload type(5 bits) 010  an Object with no storage besides a small
+//                                payload: booleans (payload 0 or 1), the empty
+//                                list, unspecified, void and the parentheses
+//                                produced by the tokenizer, and references
+//                                to local variables (see makeLocal)
+// Use typeOf instead of ->type whenever the Object might be an immediate or a
+// ConsCell.
+#define TAG_BITS 3
+#define TAG_MASK 7
+#define FIXNUM_TAG 1
+#define IMMEDIATE_TAG 2
+#define CONS_TAG 3
+
+#define FIXNUM_MIN (INTPTR_MIN >> TAG_BITS)
+#define FIXNUM_MAX (INTPTR_MAX >> TAG_BITS)
+
+#define IMMEDIATE(type, payload) ((Object *)(((uintptr_t)(payload) << 8) \
+        | ((uintptr_t)(type) << TAG_BITS) | IMMEDIATE_TAG))
+
+// The canonical payload-free Objects. There is exactly one of each, so they
+// never need to be allocated and can be compared with == (e.g. list ==
+// NULL_OBJECT rather than typeOf(list) == NULL_TYPE).
+#define NULL_OBJECT IMMEDIATE(NULL_TYPE, 0)
+#define TRUE_OBJECT IMMEDIATE(BOOL_TYPE, 1)
+#define FALSE_OBJECT IMMEDIATE(BOOL_TYPE, 0)
+#define UNSPECIFIED_OBJECT IMMEDIATE(UNSPECIFIED_TYPE, 0)
+#define VOID_OBJECT IMMEDIATE(VOID_TYPE, 0)
+#define OPEN_OBJECT IMMEDIATE(OPEN_TYPE, 0)
+#define CLOSE_OBJECT IMMEDIATE(CLOSE_TYPE, 0)
+#define CLOSEBRACE_OBJECT IMMEDIATE(CLOSEBRACE_TYPE, 0)
+#define FORWARD_OBJECT IMMEDIATE(FORWARD_TYPE, 0)
+
+// Input obj: Any Object.
+// Return: True if obj is a fixnum or another immediate rather than a pointer.
+static inline bool isImmediate(Object *obj) {
+    uintptr_t tag = (uintptr_t)obj & TAG_MASK;
+    return tag == FIXNUM_TAG || tag == IMMEDIATE_TAG;
+}
+
+// Input obj: Any Object.
+// Return: True if obj points to a ConsCell.
+static inline bool isCons(Object *obj) {
+    return ((uintptr_t)obj & TAG_MASK) == CONS_TAG;
+}
+
+// Input obj: An Object that points to a ConsCell.
+// Return: The ConsCell itself.
+static inline ConsCell *consCell(Object *obj) {
+    return (ConsCell *)((uintptr_t)obj - CONS_TAG);
+}
+
+// Input cell: A ConsCell.
+// Return: The Object that points to it.
+static inline Object *tagCons(ConsCell *cell) {
+    return (Object *)((uintptr_t)cell | CONS_TAG);
+}
+
+// Input obj: An Object that is not an immediate.
+// Return: The address of the heap memory it points to.
+static inline void *objectAddress(Object *obj) {
+    return (void *)((uintptr_t)obj & ~(uintptr_t)TAG_MASK);
+}
+
+// Input obj: Any Object.
+// Return: The type of obj, whether it is an immediate or on the heap.
+static inline objectType typeOf(Object *obj) {
+    uintptr_t tag = (uintptr_t)obj & TAG_MASK;
+    if (tag == 0) {
+        return obj->type;
+    }
+    if (tag == CONS_TAG) {
+        return CONS_TYPE;
+    }
+    if (tag == FIXNUM_TAG) {
+        return INT_TYPE;
+    }
+    return (objectType)(((uintptr_t)obj >> TAG_BITS) & 0x1f);
+}
+
+// Input obj: Any Object.
+// Return: The special form that obj names, or NO_FORM if obj is not a Symbol
+// or not the name of a special form.
+static inline specialForm formOf(Object *obj) {
+    if (((uintptr_t)obj & TAG_MASK) != 0 || obj->type != SYMBOL_TYPE) {
+        return NO_FORM;
+    }
+    return ((Symbol *)obj)->form;
+}
+
+// Input type: A type whose objects carry no storage, such as NULL_TYPE.
+// Input payload: A small value stored along with the type.
+// Return: The immediate Object for that type and payload.
+static inline Object *makeImmediate(objectType type, uintptr_t payload) {
+    return IMMEDIATE(type, payload);
+}
+
+// Input obj: An immediate made by makeImmediate.
+// Return: Its payload.
+static inline uintptr_t immediatePayload(Object *obj) {
+    return (uintptr_t)obj >> 8;
+}
+
+// Input depth: How many frames up from the current one a variable lives.
+// Input slot: The index of the variable in the slots of that frame.
+// Return: The immediate Object of LOCAL_TYPE that stands for a reference to
+// the variable. The resolver (see resolve.h) puts these in place of symbols.
+static inline Object *makeLocal(uintptr_t depth, uintptr_t slot) {
+    return IMMEDIATE(LOCAL_TYPE, depth << 8 | slot);
+}
+
+// Input obj: An Object of LOCAL_TYPE.
+// Return: How many frames up the variable lives.
+static inline uintptr_t localDepth(Object *obj) {
+    return immediatePayload(obj) >> 8;
+}
+
+// Input obj: An Object of LOCAL_TYPE.
+// Return: The index of the variable in the slots of its frame.
+static inline uintptr_t localSlot(Object *obj) {
+    return immediatePayload(obj) & 0xff;
+}
+
+// Input type: Any type.
+// Return: The name of the type, for statistics and debugging output.
+static inline const char *typeName(objectType type) {
+    switch (type) {
+        case INT_TYPE: return "integer";
+        case DOUBLE_TYPE: return "double";
+        case STR_TYPE: return "string";
+        case CONS_TYPE: return "cons";
+        case NULL_TYPE: return "null";
+        case PTR_TYPE: return "pointer";
+        case OPEN_TYPE: return "open";
+        case CLOSE_TYPE: return "close";
+        case BOOL_TYPE: return "boolean";
+        case SYMBOL_TYPE: return "symbol";
+        case CLOSEBRACE_TYPE: return "closebrace";
+        case UNSPECIFIED_TYPE: return "unspecified";
+        case VOID_TYPE: return "void";
+        case CLOSURE_TYPE: return "closure";
+        case PRIMITIVE_TYPE: return "primitive";
+        case FRAME_TYPE: return "frame";
+        case FORWARD_TYPE: return "forward";
+        case LOCAL_TYPE: return "local";
+        default: return "unknown";
+    }
+}
+
+// Input value: An integer in [FIXNUM_MIN, FIXNUM_MAX].
+// Return: The fixnum Object for that integer.
+static inline Object *makeFixnum(intptr_t value) {
+    return (Object *)(((uintptr_t)value << TAG_BITS) | FIXNUM_TAG);
+}
+
+// Input obj: An Object of INT_TYPE, either a fixnum or a boxed Integer.
+// Return: Its value.
+static inline int intValue(Object *obj) {
+    if (((uintptr_t)obj & TAG_MASK) == FIXNUM_TAG) {
+        return (int)((intptr_t)obj >> TAG_BITS);
+    }
+    return ((Integer *)obj)->value;
+}
+
+// Input value: 0 for false, anything else for true.
+// Return: The Object #f or #t.
+static inline Object *makeBool(int value) {
+    return value ? TRUE_OBJECT : FALSE_OBJECT;
+}
+
+// Input obj: An Object of BOOL_TYPE.
+// Return: 0 for #f, 1 for #t.
+static inline int boolValue(Object *obj) {
+    return (int)immediatePayload(obj);
+}
+
 #endif
 
 
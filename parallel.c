@@ -0,0 +1,182 @@
+// parallel.c by Leon Liang
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "object.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "parallel.h"
+
+// Programs smaller than this are parsed on one thread, since starting threads
+// would take longer than the parse itself.
+#define PARALLEL_MIN_BYTES (1024 * 1024)
+
+// One piece of the program, and what became of it.
+typedef struct Chunk {
+    const char *text;
+    size_t length;
+    Object *head;               // the first cell of the piece's forest
+    Object *tail;               // the last cell of the piece's forest
+    bool ok;                    // whether the piece parsed without errors
+    TallocHeap *heap;           // everything the piece's thread allocated
+    pthread_t thread;
+    bool started;               // whether a thread was started for the piece
+} Chunk;
+
+// Helper function
+// Input text: The characters of a program.
+// Input length: The number of characters in text.
+// Input count: How many pieces to cut text into.
+// Input splits: Where to store count + 1 offsets; piece i runs from splits[i]
+// up to splits[i + 1].
+// Return: True if text could be cut. The cuts are at whitespace between
+// top-level expressions, outside of strings and comments, and never between a
+// close brace and the token after it, so that each piece parses on its own
+// exactly like it would as part of the whole. If the parens do not add up,
+// false is returned and the caller should parse text as a whole to report the
+// error.
+static bool findSplits(const char *text, size_t length, int count, size_t *splits){
+    int depth = 0;
+    bool afterBrace = false;
+    int found = 1;
+    size_t target = length / count;
+    splits[0] = 0;
+    for (size_t i = 0; i < length && found < count; i++){
+        char ch = text[i];
+        if (ch == '"'){
+            const char *quote = memchr(text + i + 1, '"', length - i - 1);
+            if (quote == NULL){
+                return false;
+            }
+            i = quote - text;
+            afterBrace = false;
+        }
+        else if (ch == ';'){
+            const char *newline = memchr(text + i, '\n', length - i);
+            i = newline == NULL ? length : (size_t)(newline - text);
+        }
+        else if (ch == ' ' || (ch >= '\t' && ch <= '\r')){
+            if (i >= target && depth == 0 && !afterBrace){
+                splits[found++] = i;
+                target = length / count * found;
+            }
+        }
+        else if (ch == '('){
+            depth++;
+            afterBrace = false;
+        }
+        else if (ch == ')'){
+            if (depth == 0){
+                return false;
+            }
+            depth--;
+            afterBrace = false;
+        }
+        else if (ch == '}'){
+            if (depth == 0){
+                return false;
+            }
+            depth = 0;
+            afterBrace = true;
+        }
+        else {
+            afterBrace = false;
+        }
+    }
+    while (found <= count){
+        splits[found++] = length;
+    }
+    return true;
+}
+
+// Helper function
+// Input arg: The Chunk to parse.
+// Return: NULL. Runs on a thread of its own, whose objects are then handed
+// over to the thread that started it.
+static void *parseChunk(void *arg){
+    Chunk *chunk = arg;
+    tnurserySetEnabled(false);
+    chunk->ok = parseForest(tokenizerOpenBuffer(chunk->text, chunk->length, true),
+                            &chunk->head, &chunk->tail);
+    chunk->heap = tallocDetach();
+    return NULL;
+}
+
+// Input text: The characters of a Scheme program, as read by readSource.
+// Input length: The number of characters in text.
+// Input threads: How many threads may parse at the same time.
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// of the whole program, just like parseAll. Large programs are cut into pieces
+// between top-level expressions, and each piece is tokenized and parsed on a
+// thread of its own. If a syntax error is encountered, then the program is
+// parsed again from the start on one thread, so that the same error message as
+// from parseAll is printed before the program cleanly exits.
+Object *parseParallel(const char *text, size_t length, int threads){
+    if (threads > 1 && length / threads < PARALLEL_MIN_BYTES / 4){
+        threads = length / (PARALLEL_MIN_BYTES / 4);
+    }
+    if (threads < 1){
+        threads = 1;
+    }
+    size_t *splits = malloc((threads + 1) * sizeof(size_t));
+    Chunk *chunks = calloc(threads, sizeof(Chunk));
+    if (splits == NULL || chunks == NULL){
+        printf("Syntax error: out of memory\n");
+        texit(1);
+    }
+
+    bool ok = false;
+    Object *head = NULL_OBJECT;
+    if (length >= PARALLEL_MIN_BYTES && threads > 1
+            && findSplits(text, length, threads, splits)){
+        internSetShared(true);
+        for (int i = 0; i < threads; i++){
+            chunks[i].text = text + splits[i];
+            chunks[i].length = splits[i + 1] - splits[i];
+        }
+        // The first piece is parsed here while the others are on their way
+        for (int i = 1; i < threads; i++){
+            chunks[i].started = pthread_create(&chunks[i].thread, NULL, parseChunk, &chunks[i]) == 0;
+        }
+        ok = parseForest(tokenizerOpenBuffer(chunks[0].text, chunks[0].length, true),
+                         &chunks[0].head, &chunks[0].tail);
+        for (int i = 1; i < threads; i++){
+            if (chunks[i].started){
+                pthread_join(chunks[i].thread, NULL);
+                tallocAdopt(chunks[i].heap);
+            }
+            ok = ok && chunks[i].started && chunks[i].ok;
+        }
+        internSetShared(false);
+
+        // Stitch the forests together in order. The cells of the other pieces
+        // are all old, so no write barrier is needed.
+        Object *tail = NULL_OBJECT;
+        for (int i = 0; ok && i < threads; i++){
+            if (chunks[i].head == NULL_OBJECT){
+                continue;
+            }
+            if (tail == NULL_OBJECT){
+                head = chunks[i].head;
+            }
+            else {
+                consCell(tail)->cdr = chunks[i].head;
+            }
+            tail = chunks[i].tail;
+        }
+    }
+
+    if (!ok){
+        head = parseAll(tokenizerOpenBuffer(text, length, false));
+    }
+    free(splits);
+    free(chunks);
+    return head;
+}
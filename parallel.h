@@ -0,0 +1,18 @@
+#include <stddef.h>
+#include "object.h"
+
+#ifndef _PARALLEL
+#define _PARALLEL
+
+// Input text: The characters of a Scheme program, as read by readSource.
+// Input length: The number of characters in text.
+// Input threads: How many threads may parse at the same time.
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// of the whole program, just like parseAll. Large programs are cut into pieces
+// between top-level expressions, and each piece is tokenized and parsed on a
+// thread of its own. If a syntax error is encountered, then the program is
+// parsed again from the start on one thread, so that the same error message as
+// from parseAll is printed before the program cleanly exits.
+Object *parseParallel(const char *text, size_t length, int threads);
+
+#endif
@@ -1,6 +1,7 @@
 //parser.c by Leon Liang
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
 #include "object.h"
@@ -9,103 +10,279 @@
 #include "tokenizer.h"
 #include "parser.h"
 
+// One list that is still open while parsing: its first and last cell, so
+// that items are appended in order without reversing anything afterwards.
+struct ParseLevel {
+    Object *head;
+    Object *tail;
+};
+
+// Helper function
+// Input head: The address of the first cell of a list.
+// Input tail: The address of the last cell of the list.
+// Input item: The Object to append.
+// Appends item to the list in place. The parser never runs while the garbage
+// collector does, and the new cell is at least as young as the old tail, so no
+// write barrier is needed.
+void append(Object **head, Object **tail, Object *item){
+    Object *cell = cons(item, NULL_OBJECT);
+    if (*head == NULL_OBJECT){
+        *head = cell;
+    }
+    else{
+        consCell(*tail)->cdr = cell;
+    }
+    *tail = cell;
+}
+
+// Helper function
+// Input parser: The state of a parse.
+// Input message: What went wrong.
+// Remembers the first syntax error of the parse. Everything after it is
+// ignored until the error is reported (see reportError).
+void syntaxError(Parser *parser, char *message){
+    if (parser->error == NULL){
+        parser->error = message;
+    }
+}
+
+// Helper function
+// Input parser: The state of a parse.
+// Prints the syntax error of the parse, if there was one, and cleanly exits.
+void reportError(Parser *parser){
+    if (parser->error != NULL){
+        printf("%s\n", parser->error);
+        texit(1);
+    }
+}
+
+// Helper function
+// Input parser: The state of a parse.
+// Input item: A finished token or list.
+// Return: item if it is a whole top-level expression, or NULL after adding it
+// to the innermost open list.
+Object *addItem(Parser *parser, Object *item){
+    if (parser->depth == 0){
+        return item;
+    }
+    struct ParseLevel *level = &parser->levels[parser->depth - 1];
+    append(&level->head, &level->tail, item);
+    return NULL;
+}
+
+// Helper function
+// Input parser: The state of a parse with at least one open list.
+// Return: The innermost open list, now closed, if that finished a top-level
+// expression, and NULL otherwise.
+Object *closeList(Parser *parser){
+    parser->depth--;
+    return addItem(parser, parser->levels[parser->depth].head);
+}
+
+// Helper function
+// Input parser: The state of a parse.
+// Input token: The next token.
+// Return: The top-level expression that token completed, or NULL if it did not
+// complete one. Syntax errors are remembered in parser->error.
+Object *parseToken(Parser *parser, Object *token){
+    if (parser->error != NULL){
+        return NULL;
+    }
+
+    // A close brace must be followed by an open paren or the end of input
+    if (parser->afterBrace && token != OPEN_OBJECT){
+        syntaxError(parser, "Syntax error: wrong close brace usage");
+        return NULL;
+    }
+    parser->afterBrace = false;
+
+    if (token == OPEN_OBJECT){
+        if (parser->depth == parser->capacity){
+            parser->capacity = parser->capacity == 0 ? 64 : parser->capacity * 2;
+            parser->levels = realloc(parser->levels, parser->capacity * sizeof(struct ParseLevel));
+            if (parser->levels == NULL){
+                printf("Syntax error: out of memory\n");
+                texit(1);
+            }
+        }
+        parser->levels[parser->depth].head = NULL_OBJECT;
+        parser->levels[parser->depth].tail = NULL_OBJECT;
+        parser->depth++;
+        return NULL;
+    }
+    else if (token == CLOSE_OBJECT){
+        if (parser->depth == 0){
+            syntaxError(parser, "Syntax error: too many close parentheses");
+            return NULL;
+        }
+        return closeList(parser);
+    } 
+    else if (token == CLOSEBRACE_OBJECT){
+        if (parser->depth == 0){
+            syntaxError(parser, "Syntax error: too many close parens");
+            return NULL;
+        }
+        // Close every paren that is still open
+        Object *tree = NULL;
+        while (parser->depth > 0){
+            tree = closeList(parser);
+        }
+        parser->afterBrace = true;
+        return tree;
+    }
+    return addItem(parser, token);
+}
+
+// Helper function
+// Input parser: The state of a parse that has seen all of its tokens.
+// Checks that no list is left open, then reports any syntax error.
+void finishParse(Parser *parser){
+    if (parser->depth > 0){
+        syntaxError(parser, "Syntax error: not enough close parentheses");
+    }
+    reportError(parser);
+}
+
 // Input tokens: A linked list of tokens. The output of the tokenize function.
 // Return: A linked list that stores the abstract syntax tree (forest, actually) 
 // for that token list. If a syntax error is encountered, then an error message 
 // is printed and the program cleanly exits.
 Object *parse(Object *tokens){
-    Object *stack = makeNull();
-    Object *currentToken = tokens;
-    int numOpen = 0;
-    int numClose = 0;
-
-    while (currentToken->type != NULL_TYPE){
-        Object *token = car(currentToken);
-        currentToken = cdr(currentToken);
-        if (token->type == OPEN_TYPE){
-            numOpen++;
+    Parser parser;
+    parserInit(&parser, NULL);
+    Object *head = NULL_OBJECT;
+    Object *tail = NULL_OBJECT;
+    while (tokens != NULL_OBJECT){
+        Object *tree = parseToken(&parser, car(tokens));
+        reportError(&parser);
+        if (tree != NULL){
+            append(&head, &tail, tree);
         }
+        tokens = cdr(tokens);
+    }
+    finishParse(&parser);
+    parserClose(&parser);
+    return head;
+}
 
-        if (token->type == CLOSE_TYPE){
-            numClose++;
-            if (numClose > numOpen){
-                printf("Syntax error: too many close parentheses\n");
-                texit(1);
-            }
-
-            // Start building a list until an open paren
-            Object *list = makeNull();
-            // Pop tokens off the stack and append them to a list
-            while (car(stack)->type != OPEN_TYPE){
-                list = cons(car(stack),list);
-                stack = cdr(stack);
-            }
-            stack = cdr(stack);  // Discard the open paren
-            stack = cons(list,stack);
-        } 
-        else if (token->type == CLOSEBRACE_TYPE){
-            if (numClose >= numOpen){
-                printf("Syntax error: too many close parens\n");
-                texit(1);
-            }
-            if (currentToken->type != NULL_TYPE){
-                if (car(currentToken)->type != OPEN_TYPE){
-                    printf("Syntax error: wrong close brace usage\n");
-                    texit(1);
-                }
-            }
-            for (int i = numClose; i < numOpen; i++) {
-                numClose++;
-                // Start building a list until an open paren
-                Object *list = makeNull();
-                // Pop tokens off the stack and append them to a list
-                while (car(stack)->type != OPEN_TYPE){
-                    list = cons(car(stack),list);
-                    stack = cdr(stack);
-                }
-                stack = cdr(stack);  // Discard the open paren
-                stack = cons(list,stack);
-            }
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// for all tokens of tokenizer, which is then closed. The tree is built while
+// the input is read, without a list of tokens in between. As with tokenize and
+// parse, an unrecognized character is reported before any syntax error in the
+// structure of the program, and the program cleanly exits.
+Object *parseAll(Tokenizer *tokenizer){
+    Parser parser;
+    parserInit(&parser, tokenizer);
+    Object *head = NULL_OBJECT;
+    Object *tail = NULL_OBJECT;
+    Object *token;
+    while ((token = nextToken(tokenizer)) != NULL){
+        Object *tree = parseToken(&parser, token);
+        if (tree != NULL){
+            append(&head, &tail, tree);
         }
-        else{
-            stack = cons(token, stack);  // Push the token onto the stack if it's not ')' or '}'
+    }
+    finishParse(&parser);
+    parserClose(&parser);
+    tokenizerClose(tokenizer);
+    return head;
+}
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpenBuffer with
+// recover set.
+// Input head: Where to store the first cell of the forest.
+// Input tail: Where to store the last cell of the forest.
+// Return: True if all tokens of tokenizer, which is then closed, make up a
+// forest without syntax errors. Unlike parseAll, nothing is printed and the
+// program goes on after an error, so that a caller can parse again to report
+// it (see parseParallel).
+bool parseForest(Tokenizer *tokenizer, Object **head, Object **tail){
+    Parser parser;
+    parserInit(&parser, tokenizer);
+    *head = NULL_OBJECT;
+    *tail = NULL_OBJECT;
+    Object *token;
+    while ((token = nextToken(tokenizer)) != NULL){
+        Object *tree = parseToken(&parser, token);
+        if (tree != NULL){
+            append(head, tail, tree);
         }
     }
-    if (numClose < numOpen){
-        printf("Syntax error: not enough close parentheses\n");
-        texit(1);
+    if (parser.depth > 0){
+        syntaxError(&parser, "Syntax error: not enough close parentheses");
     }
+    bool ok = parser.error == NULL && !tokenizerFailed(tokenizer);
+    parserClose(&parser);
+    tokenizerClose(tokenizer);
+    return ok;
+}
+
+// Input parser: A Parser.
+// Input tokenizer: Where parseNext gets its tokens from.
+// Prepares parser to parse the tokens of tokenizer one top-level expression at
+// a time.
+void parserInit(Parser *parser, Tokenizer *tokenizer){
+    parser->tokenizer = tokenizer;
+    parser->levels = NULL;
+    parser->depth = 0;
+    parser->capacity = 0;
+    parser->afterBrace = false;
+    parser->error = NULL;
+}
 
-    return reverse(stack);
+// Input parser: A Parser, prepared with parserInit.
+// Gives back the memory of parser. The trees it returned stay valid.
+void parserClose(Parser *parser){
+    free(parser->levels);
+    parser->levels = NULL;
+    parser->capacity = 0;
+}
+
+// Input parser: A Parser, prepared with parserInit.
+// Return: The abstract syntax tree of the next top-level expression, as soon as
+// its last token has been read, or NULL at the end of the input. If a syntax
+// error is encountered, then an error message is printed and the program
+// cleanly exits.
+Object *parseNext(Parser *parser){
+    Object *token;
+    while ((token = nextToken(parser->tokenizer)) != NULL){
+        Object *tree = parseToken(parser, token);
+        reportError(parser);
+        if (tree != NULL){
+            return tree;
+        }
+    }
+    finishParse(parser);
+    return NULL;
 }
 
 // Helper function to print an token
 void printObject(Object *obj){
-    if (obj->type == INT_TYPE){
-        printf("%d", ((Integer *)obj)->value);
+    if (typeOf(obj) == INT_TYPE){
+        printf("%d", intValue(obj));
     } 
-    else if (obj->type == DOUBLE_TYPE){
+    else if (typeOf(obj) == DOUBLE_TYPE){
         printf("%f", ((Double *)obj)->value);
     } 
-    else if (obj->type == STR_TYPE){
+    else if (typeOf(obj) == STR_TYPE){
         printf("\"%s\"", ((String *)obj)->value);
     } 
-    else if (obj->type == SYMBOL_TYPE){
+    else if (typeOf(obj) == SYMBOL_TYPE){
         printf("%s", ((Symbol *)obj)->value);
     } 
-    else if (obj->type == BOOL_TYPE){
-        Boolean *boolToken = (Boolean *)obj;
-        if (boolToken->value == 0){
+    else if (typeOf(obj) == BOOL_TYPE){
+        if (boolValue(obj) == 0){
             printf("#f");
         }
-        else if (boolToken->value == 1){
+        else if (boolValue(obj) == 1){
             printf("#t");
         }
     } 
-    else if (obj->type == CONS_TYPE){
+    else if (typeOf(obj) == CONS_TYPE){
         printTree(obj);
     } 
-    else if (obj->type == NULL_TYPE){
+    else if (obj == NULL_OBJECT){
         printf("()");
     }
 }
@@ -116,10 +293,10 @@ void printObject(Object *obj){
 void printTree(Object *tree) {
     Object *current = tree;
     
-    while (current->type != NULL_TYPE) {
+    while (current != NULL_OBJECT) {
         Object *item = car(current);
 
-        if (item->type == CONS_TYPE) {
+        if (typeOf(item) == CONS_TYPE) {
             printf("(");
             printTree(item);
             printf(")");
@@ -129,7 +306,7 @@ void printTree(Object *tree) {
 
         current = cdr(current);
         
-        if (current->type != NULL_TYPE) {
+        if (current != NULL_OBJECT) {
             printf(" ");
         }
     }
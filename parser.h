@@ -1,17 +1,65 @@
 
 
 
+#include <stdbool.h>
 #include "object.h"
+#include "tokenizer.h"
 
 #ifndef _PARSER
 #define _PARSER
 
+// The state of a parse that reads one top-level expression at a time from a
+// Tokenizer (see parseNext).
+typedef struct Parser {
+    Tokenizer *tokenizer;
+    struct ParseLevel *levels;  // the lists that are open, outermost first
+    int depth;                  // parens that are open
+    int capacity;               // room in levels
+    bool afterBrace;            // whether the last token was a close brace
+    char *error;                // the first syntax error, or NULL
+} Parser;
+
 // Input tokens: A linked list of tokens. The output of the tokenize function.
 // Return: A linked list that stores the abstract syntax tree (forest, actually) 
 // for that token list. If a syntax error is encountered, then an error message 
 // is printed and the program cleanly exits.
 Object *parse(Object *tokens);
 
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Return: A linked list that stores the abstract syntax tree (forest, actually)
+// for all tokens of tokenizer, which is then closed. The tree is built while
+// the input is read, without a list of tokens in between. As with tokenize and
+// parse, an unrecognized character is reported before any syntax error in the
+// structure of the program, and the program cleanly exits.
+Object *parseAll(Tokenizer *tokenizer);
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpenBuffer with
+// recover set.
+// Input head: Where to store the first cell of the forest.
+// Input tail: Where to store the last cell of the forest.
+// Return: True if all tokens of tokenizer, which is then closed, make up a
+// forest without syntax errors. Unlike parseAll, nothing is printed and the
+// program goes on after an error, so that a caller can parse again to report
+// it (see parseParallel).
+bool parseForest(Tokenizer *tokenizer, Object **head, Object **tail);
+
+// Input parser: A Parser.
+// Input tokenizer: Where parseNext gets its tokens from.
+// Prepares parser to parse the tokens of tokenizer one top-level expression at
+// a time.
+void parserInit(Parser *parser, Tokenizer *tokenizer);
+
+// Input parser: A Parser, prepared with parserInit.
+// Gives back the memory of parser. The trees it returned stay valid.
+void parserClose(Parser *parser);
+
+// Input parser: A Parser, prepared with parserInit.
+// Return: The abstract syntax tree of the next top-level expression, as soon as
+// its last token has been read, or NULL at the end of the input. If a syntax
+// error is encountered, then an error message is printed and the program
+// cleanly exits.
+Object *parseNext(Parser *parser);
+
 // Input tree: An abstract syntax tree (forest). The output of parse.
 // Prints the tree in a human-readable format that closely resembles the 
 // original Scheme code that led to the abstract syntax tree.
@@ -0,0 +1,202 @@
+// resolve.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "object.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "resolve.h"
+
+// What the resolver knows about a frame that will exist at run time: the
+// names of its slots, and the names that define may bind in it. A define can
+// shadow a slot of an outer frame, or run only sometimes, so a name that is
+// defined in a frame is always looked up by name from there on out.
+typedef struct Scope {
+    Object *names;          // a parameter list or the bindings of a let
+    Object **defined;
+    size_t definedCount;
+    size_t definedCapacity;
+    struct Scope *outer;    // the frame the frame is nested in, or NULL
+} Scope;
+
+// Helper function
+// Input list: Any Object.
+// Return: The car of list if it is a cons cell, otherwise the empty list.
+static Object *first(Object *list){
+    return isCons(list) ? consCell(list)->car : NULL_OBJECT;
+}
+
+// Helper function
+// Input list: Any Object.
+// Return: The cdr of list if it is a cons cell, otherwise NULL_OBJECT.
+static Object *rest(Object *list){
+    return isCons(list) ? consCell(list)->cdr : NULL_OBJECT;
+}
+
+// Helper function
+// Input scope: A Scope.
+// Input symbol: A name that a define in the frame of scope binds.
+static void addDefined(Scope *scope, Object *symbol){
+    if (scope->definedCount == scope->definedCapacity) {
+        scope->definedCapacity = scope->definedCapacity == 0 ? 8 : 2 * scope->definedCapacity;
+        scope->defined = realloc(scope->defined, scope->definedCapacity * sizeof(Object *));
+        if (scope->defined == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+    }
+    scope->defined[scope->definedCount++] = symbol;
+}
+
+// Helper function
+// Input expr: An expression that is evaluated in the frame of scope.
+// Input scope: A Scope.
+// Adds every name that a define in expr binds in the frame of scope. The
+// bodies of lambdas and lets run in frames of their own and are skipped, but
+// the values of a let's bindings are evaluated in the frame around it.
+static void collectDefines(Object *expr, Scope *scope){
+    if (!isCons(expr)) {
+        return;
+    }
+    specialForm form = formOf(first(expr));
+    if (form == QUOTE_FORM || form == LAMBDA_FORM) {
+        return;
+    }
+    if (form == LET_FORM) {
+        for (Object *pairs = first(rest(expr)); isCons(pairs); pairs = rest(pairs)) {
+            collectDefines(first(rest(first(pairs))), scope);
+        }
+        return;
+    }
+    if (form == DEFINE_FORM && typeOf(first(rest(expr))) == SYMBOL_TYPE) {
+        addDefined(scope, first(rest(expr)));
+    }
+    for (Object *current = expr; isCons(current); current = rest(current)) {
+        collectDefines(first(current), scope);
+    }
+}
+
+// Helper function
+// Input symbol: A Symbol that is evaluated in the frame of scope.
+// Input scope: A Scope, or NULL for the global frame.
+// Return: A reference to the slot that symbol names, or symbol itself if it
+// must be looked up by name.
+static Object *resolveSymbol(Object *symbol, Scope *scope){
+    uintptr_t depth = 0;
+    for (; scope != NULL; scope = scope->outer, depth++) {
+        for (size_t i = 0; i < scope->definedCount; i++) {
+            if (scope->defined[i] == symbol) {
+                return symbol;
+            }
+        }
+        uintptr_t slot = 0;
+        for (Object *names = scope->names; isCons(names); names = rest(names), slot++) {
+            Object *name = first(names);
+            if (isCons(name)) {
+                name = first(name); // a let binding (name value)
+            }
+            if (name == symbol) {
+                return slot < FRAME_SLOTS_MAX ? makeLocal(depth, slot) : symbol;
+            }
+        }
+    }
+    return symbol;
+}
+
+static void resolveForm(Object *form, Scope *scope);
+
+// Helper function
+// Input list: A list of expressions that are evaluated in the frame of scope.
+// Input scope: A Scope, or NULL for the global frame.
+// Resolves each expression in the list in place.
+static void resolveList(Object *list, Scope *scope){
+    for (; isCons(list); list = rest(list)) {
+        Object *expr = first(list);
+        if (typeOf(expr) == SYMBOL_TYPE) {
+            consCell(list)->car = resolveSymbol(expr, scope);
+        }
+        else if (isCons(expr)) {
+            resolveForm(expr, scope);
+        }
+    }
+}
+
+// Helper function
+// Input body: The body of a lambda or let.
+// Input names: The names of the slots of the frame the body runs in.
+// Input outer: The Scope around the lambda or let.
+// Resolves the body in a new Scope for its frame.
+static void resolveBody(Object *body, Object *names, Scope *outer){
+    Scope scope = {names, NULL, 0, 0, outer};
+    for (Object *current = body; isCons(current); current = rest(current)) {
+        collectDefines(first(current), &scope);
+    }
+    resolveList(body, &scope);
+    free(scope.defined);
+}
+
+// Helper function
+// Input form: A cons cell that is evaluated in the frame of scope.
+// Input scope: A Scope, or NULL for the global frame.
+// Resolves form in place. A malformed lambda or let is left as it is, since
+// evaluating it is an error anyway.
+static void resolveForm(Object *form, Scope *scope){
+    switch (formOf(first(form))) {
+        case QUOTE_FORM:
+            break;
+        case IF_FORM:
+            resolveList(rest(form), scope);
+            break;
+        case DEFINE_FORM:
+            resolveList(rest(rest(form)), scope);
+            break;
+        case LAMBDA_FORM: {
+            Object *params = first(rest(form));
+            Object *current = params;
+            while (isCons(current) && typeOf(first(current)) == SYMBOL_TYPE) {
+                current = rest(current);
+            }
+            if (current == NULL_OBJECT) {
+                resolveBody(rest(rest(form)), params, scope);
+            }
+            break;
+        }
+        case LET_FORM: {
+            Object *pairs = first(rest(form));
+            Object *current = pairs;
+            while (isCons(current) && typeOf(first(first(current))) == SYMBOL_TYPE
+                    && isCons(rest(first(current)))) {
+                current = rest(current);
+            }
+            if (current != NULL_OBJECT) {
+                break;
+            }
+            // The values are evaluated in the frame around the let
+            for (current = pairs; isCons(current); current = rest(current)) {
+                resolveList(rest(first(current)), scope);
+            }
+            resolveBody(rest(rest(form)), pairs, scope);
+            break;
+        }
+        case NO_FORM:
+            resolveList(form, scope);
+            break;
+    }
+}
+
+// Input tree: The abstract syntax tree of a single top-level expression, as
+// returned by the parser.
+// Return: tree, in which every reference to a parameter of a lambda or a
+// variable of a let has been replaced by a reference to a slot of a frame
+// (see makeLocal), so that eval finds the value without comparing names. The
+// tree is changed in place. References that could be to a binding made by
+// define at run time, references to globals and everything in a quote are left
+// alone, and so is any expression with a syntax error, which eval reports when
+// it gets to it. The special forms are recognized by the forms of their
+// Symbols, which globalEnvironment assigns.
+Object *resolve(Object *tree){
+    if (isCons(tree)) {
+        resolveForm(tree, NULL);
+    }
+    return tree;
+}
@@ -0,0 +1,18 @@
+#include "object.h"
+
+#ifndef _RESOLVE
+#define _RESOLVE
+
+// Input tree: The abstract syntax tree of a single top-level expression, as
+// returned by the parser.
+// Return: tree, in which every reference to a parameter of a lambda or a
+// variable of a let has been replaced by a reference to a slot of a frame
+// (see makeLocal), so that eval finds the value without comparing names. The
+// tree is changed in place. References that could be to a binding made by
+// define at run time, references to globals and everything in a quote are left
+// alone, and so is any expression with a syntax error, which eval reports when
+// it gets to it. The special forms are recognized by the forms of their
+// Symbols, which globalEnvironment assigns.
+Object *resolve(Object *tree);
+
+#endif
@@ -0,0 +1,147 @@
+// symbol.c by Leon Liang
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "object.h"
+#include "talloc.h"
+#include "symbol.h"
+
+// Every Symbol ever made, in an open-addressing hash table with linear
+// probing. The table is doubled whenever it becomes half full. Symbols and
+// their names live in the talloc arena, which is never collected. Each slot
+// keeps the hash and length of its name, so that probing past other names
+// rarely has to look at the Symbol itself.
+#define INITIAL_CAPACITY 1024
+
+typedef struct Entry {
+    uint32_t hash;
+    uint32_t length;
+    Symbol *symbol;         // NULL if the slot is empty
+} Entry;
+
+static Entry *table = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+// While several threads parse at once, the table is guarded by a lock. A
+// single thread does not pay for it.
+static bool shared = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Helper function
+// Input name: The characters of a name.
+// Input length: The number of characters.
+// Return: The FNV-1a hash of the name.
+static uint32_t hashName(const char *name, size_t length){
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Helper function
+// Input newCapacity: The new number of slots, a power of two.
+// Moves every symbol into a table with the given number of slots.
+static void resize(size_t newCapacity){
+    Entry *newTable = calloc(newCapacity, sizeof(Entry));
+    if (newTable == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        if (table[i].symbol != NULL) {
+            size_t slot = table[i].hash & (newCapacity - 1);
+            while (newTable[slot].symbol != NULL) {
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            newTable[slot] = table[i];
+        }
+    }
+    free(table);
+    table = newTable;
+    capacity = newCapacity;
+}
+
+// Input name: The characters of a symbol's name. They need not be terminated.
+// Input length: The number of characters in name.
+// Return: The one Symbol with that name. The first time a name is seen, a new
+// Symbol is allocated for it; afterwards the same Symbol is returned, so two
+// symbols have the same name exactly when they are the same pointer.
+Symbol *intern(const char *name, size_t length){
+    uint32_t hash = hashName(name, length);
+    if (shared) {
+        pthread_mutex_lock(&lock);
+    }
+    if (2 * (count + 1) > capacity) {
+        resize(capacity == 0 ? INITIAL_CAPACITY : capacity * 2);
+    }
+
+    size_t slot = hash & (capacity - 1);
+    while (table[slot].symbol != NULL) {
+        Entry *entry = &table[slot];
+        if (entry->hash == hash && entry->length == length
+                && memcmp(entry->symbol->value, name, length) == 0) {
+            Symbol *symbol = entry->symbol;
+            if (shared) {
+                pthread_mutex_unlock(&lock);
+            }
+            return symbol;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    Symbol *symbol = tallocObject(SYMBOL_TYPE, sizeof(Symbol));
+    symbol->type = SYMBOL_TYPE;
+    symbol->form = NO_FORM;
+    symbol->value = talloc(length + 1);
+    memcpy(symbol->value, name, length);
+    symbol->value[length] = '\0';
+    table[slot].hash = hash;
+    table[slot].length = (uint32_t)length;
+    table[slot].symbol = symbol;
+    count++;
+    if (shared) {
+        pthread_mutex_unlock(&lock);
+    }
+    return symbol;
+}
+
+// Input symbol: A Symbol that was not made by intern, e.g. one loaded from a
+// heap image.
+// Return: True if symbol is now the one Symbol with its name, which intern
+// returns from then on, and false if another Symbol already has that name.
+bool internSymbol(Symbol *symbol){
+    if (2 * (count + 1) > capacity) {
+        resize(capacity == 0 ? INITIAL_CAPACITY : capacity * 2);
+    }
+    size_t length = strlen(symbol->value);
+    uint32_t hash = hashName(symbol->value, length);
+    size_t slot = hash & (capacity - 1);
+    while (table[slot].symbol != NULL) {
+        Entry *entry = &table[slot];
+        if (entry->hash == hash && entry->length == length
+                && memcmp(entry->symbol->value, symbol->value, length) == 0) {
+            return entry->symbol == symbol;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+    table[slot].hash = hash;
+    table[slot].length = (uint32_t)length;
+    table[slot].symbol = symbol;
+    count++;
+    return true;
+}
+
+// Input enabled: Whether other threads may call intern at the same time.
+// Must not be changed while another thread is interning.
+void internSetShared(bool enabled){
+    shared = enabled;
+}
@@ -0,0 +1,25 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include "object.h"
+
+#ifndef _SYMBOL
+#define _SYMBOL
+
+// Input name: The characters of a symbol's name. They need not be terminated.
+// Input length: The number of characters in name.
+// Return: The one Symbol with that name. The first time a name is seen, a new
+// Symbol is allocated for it; afterwards the same Symbol is returned, so two
+// symbols have the same name exactly when they are the same pointer.
+Symbol *intern(const char *name, size_t length);
+
+// Input symbol: A Symbol that was not made by intern, e.g. one loaded from a
+// heap image.
+// Return: True if symbol is now the one Symbol with its name, which intern
+// returns from then on, and false if another Symbol already has that name.
+bool internSymbol(Symbol *symbol);
+
+// Input enabled: Whether other threads may call intern at the same time.
+// Must not be changed while another thread is interning.
+void internSetShared(bool enabled);
+
+#endif
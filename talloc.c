@@ -1,49 +1,734 @@
 // talloc.c by Leon Liang
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
 #include "talloc.h"
 
-typedef struct MemNode {
-    void *ptr;            
-    struct MemNode *next;   
-} MemNode;
+// Memory is handed out from large chunks with a bump pointer, so a talloc is
+// usually just an addition and a comparison. Every chunk is remembered in
+// chunkList, which means tfree only has to walk the chunks, not the objects.
+#define CHUNK_SIZE (64 * 1024)
 
-static MemNode *memList = NULL;
+// Requests bigger than this get a dedicated chunk of their own, so a single
+// long string does not waste the rest of the current chunk.
+#define LARGE_ALLOC (CHUNK_SIZE / 4)
+
+// Every pointer returned by talloc is a multiple of this. Eight bytes is
+// enough for every struct in object.h, including Double.
+#define ALIGNMENT 8
+
+// Chunks, slabs and nursery blocks all start with a Block header and are
+// aligned to CHUNK_SIZE, so the header of any object can be found by masking
+// its address. The pool member tells slabs apart from the other two.
+#define ARENA_BLOCK -1
+#define NURSERY_BLOCK -2
+
+typedef struct Block {
+    struct Block *next;
+    size_t size;            // bytes taken from the system, header included
+    int pool;               // a poolClass, ARENA_BLOCK or NURSERY_BLOCK
+    bool mapped;            // whether the block is part of a heap image
+} Block;
+
+// The header is padded so the first allocation in a chunk is aligned too.
+#define CHUNK_HEADER ((sizeof(Block) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+// All allocator state below is per thread, so that several threads can parse
+// at the same time without locking (see tallocDetach and tallocAdopt). Only
+// the thread that runs the interpreter ever collects garbage.
+static _Thread_local Block *chunkList = NULL;
+static _Thread_local char *bumpPtr = NULL;   // next free byte in the current chunk
+static _Thread_local char *bumpEnd = NULL;   // one past the last byte of the current chunk
+
+// Pooled objects come from slabs that hold objects of a single pool only.
+// Each slab keeps one bit per object slot for "handed out" and one for
+// "marked by the collector".
+#define SLAB_SIZE CHUNK_SIZE
+#define SLAB_BITS (SLAB_SIZE / ALIGNMENT)
+#define WORD_BITS (8 * sizeof(unsigned long))
+
+typedef struct Slab {
+    Block block;
+    unsigned long used[SLAB_BITS / WORD_BITS];
+    unsigned long marks[SLAB_BITS / WORD_BITS];
+} Slab;
+
+#define SLAB_HEADER ((sizeof(Slab) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+// A freed object stores the next free object of its pool in its first word.
+typedef struct FreeObject {
+    struct FreeObject *next;
+} FreeObject;
+
+typedef struct Pool {
+    size_t size;            // bytes per object, rounded up to ALIGNMENT
+    FreeObject *freeList;   // released objects, reused first
+    char *bumpPtr;          // next unused object in the newest slab
+    char *bumpEnd;          // end of the newest slab
+    Slab *slabs;
+    size_t count;           // objects currently handed out
+    size_t allocated;       // objects allocated since the program started
+    objectType type;        // the type of the objects
+} Pool;
+
+#define POOL_SIZE(type) ((sizeof(type) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+// Frames come in three sizes, by the number of slots they have room for.
+#define FRAME_SIZE(slots) (POOL_SIZE(Frame) + (slots) * sizeof(Object *))
+
+static _Thread_local Pool pools[NUM_POOLS] = {
+    [CONS_POOL] = {POOL_SIZE(ConsCell), NULL, NULL, NULL, NULL, 0, 0, CONS_TYPE},
+    [INT_POOL] = {POOL_SIZE(Integer), NULL, NULL, NULL, NULL, 0, 0, INT_TYPE},
+    [DOUBLE_POOL] = {POOL_SIZE(Double), NULL, NULL, NULL, NULL, 0, 0, DOUBLE_TYPE},
+    [FRAME_POOL] = {FRAME_SIZE(2), NULL, NULL, NULL, NULL, 0, 0, FRAME_TYPE},
+    [FRAME4_POOL] = {FRAME_SIZE(4), NULL, NULL, NULL, NULL, 0, 0, FRAME_TYPE},
+    [FRAME8_POOL] = {FRAME_SIZE(FRAME_SLOTS_MAX), NULL, NULL, NULL, NULL, 0, 0, FRAME_TYPE},
+    [CLOSURE_POOL] = {POOL_SIZE(Closure), NULL, NULL, NULL, NULL, 0, 0, CLOSURE_TYPE},
+};
+
+// Bytes of pooled objects currently handed out, across all pools.
+static _Thread_local size_t poolBytes = 0;
+
+// New pooled objects are bumped out of the nursery, a chain of blocks that the
+// collector empties as a whole. A young object takes at least YOUNG_MIN bytes,
+// so that the collector can overwrite it with a forwarding address.
+#define YOUNG_MIN 16
+
+static _Thread_local bool nurseryEnabled = true;
+static _Thread_local Block *nurseryBlocks = NULL;   // every nursery block, oldest first
+static _Thread_local Block *nurseryCurrent = NULL;  // the block being bumped through
+static _Thread_local char *youngPtr = NULL;
+static _Thread_local char *youngEnd = NULL;
+static _Thread_local size_t youngBytes = 0;         // bytes handed out since the last reset
+
+// Allocation accounting. Pooled objects are counted by their pool; objects
+// from the arena are counted here when they are allocated with tallocObject.
+// heapBytes is what is currently held from the system, and may not grow past
+// heapLimit unless that is zero.
+static _Thread_local size_t arenaBytes = 0;
+static _Thread_local size_t arenaObjects[NUM_TYPES];
+static _Thread_local size_t arenaObjectBytes[NUM_TYPES];
+static _Thread_local size_t heapBytes = 0;
+static _Thread_local size_t peakHeapBytes = 0;
+static size_t heapLimit = 0;
+
+// Helper function
+// Input size: The number of bytes the block must span, header included.
+// Input pool: The pool the block belongs to, or ARENA_BLOCK.
+// Return: A new block of at least size bytes, aligned to CHUNK_SIZE.
+static Block *newBlock(size_t size, int pool){
+    size = (size + CHUNK_SIZE - 1) & ~(size_t)(CHUNK_SIZE - 1);
+    if (heapLimit != 0 && heapBytes + size > heapLimit) {
+        printf("Evaluation error: heap limit of %zu bytes exceeded\n", heapLimit);
+        texit(1);
+    }
+    Block *block = (Block *)aligned_alloc(CHUNK_SIZE, size);
+    if (block == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    block->size = size;
+    block->pool = pool;
+    block->mapped = false;
+    heapBytes += size;
+    if (heapBytes > peakHeapBytes) {
+        peakHeapBytes = heapBytes;
+    }
+    return block;
+}
+
+// Helper function
+// Input ptr: A pointer returned by talloc, tallocPool or tallocTenured.
+// Return: The header of the block that holds ptr.
+static Block *blockOf(void *ptr){
+    return (Block *)((size_t)ptr & ~(size_t)(CHUNK_SIZE - 1));
+}
+
+// Helper function
+// Input list: A list of blocks linked through their next members.
+// Frees every block in the list. Blocks of a heap image belong to its mapping
+// and are left alone.
+static void freeBlocks(Block *list){
+    while (list != NULL) {
+        Block *nextBlock = list->next;
+        heapBytes -= list->size;
+        if (!list->mapped) {
+            free(list);
+        }
+        list = nextBlock;
+    }
+}
+
+// Helper function
+// Input size: The number of usable bytes the chunk should hold.
+// Return: A pointer to the first usable byte of a new chunk. The chunk is
+// linked into chunkList so that tfree can release it.
+static char *newChunk(size_t size){
+    Block *chunk = newBlock(CHUNK_HEADER + size, ARENA_BLOCK);
+    chunk->next = chunkList;
+    chunkList = chunk;
+    return (char *)chunk + CHUNK_HEADER;
+}
 
 // Input size: The number of bytes to allocate from the heap.
 // Return: A pointer to heap-allocated memory of size bytes. NULL upon failure.
-// A replacement for the built-in C function malloc. This function tracks the 
+// A replacement for the built-in C function malloc. This function tracks the
 // allocated heap memory in a data structure, such that tfree can free it later.
 void *talloc(size_t size){
-    //allocating memory on the heap
-    void *newptr = malloc(size);
-    assert(newptr != NULL);
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if (size == 0) {
+        size = ALIGNMENT;
+    }
+    arenaBytes += size;
+
+    // Large requests live alone; the current chunk keeps bumping afterwards
+    if (size > LARGE_ALLOC) {
+        return newChunk(size);
+    }
+
+    // Start a fresh chunk when the current one cannot fit the request
+    if (bumpPtr == NULL || (size_t)(bumpEnd - bumpPtr) < size) {
+        bumpPtr = newChunk(CHUNK_SIZE - CHUNK_HEADER);
+        bumpEnd = bumpPtr + CHUNK_SIZE - CHUNK_HEADER;
+    }
 
-    //creating memNode to keep track of memory allocated
-    MemNode *memNode = (MemNode *)malloc(sizeof(MemNode));
-    assert(memNode != NULL);
-    memNode->ptr = newptr;
+    void *newptr = bumpPtr;
+    bumpPtr += size;
+    return newptr;
+}
+
+// Input type: The type of the object.
+// Input size: The size of the object in bytes.
+// Return: Memory for an object that is never collected, like talloc. The object
+// is counted by tallocStats under its type.
+void *tallocObject(objectType type, size_t size){
+    arenaObjects[type]++;
+    arenaObjectBytes[type] += size;
+    return talloc(size);
+}
+
+// Helper function
+// Input pool: The pool that needs more room.
+// Starts a new slab for the given pool and makes it the one to bump from.
+static void newSlab(poolClass pool){
+    Slab *slab = (Slab *)newBlock(SLAB_SIZE, pool);
+    memset(slab->used, 0, sizeof(slab->used));
+    memset(slab->marks, 0, sizeof(slab->marks));
+    slab->block.next = (Block *)pools[pool].slabs;
+    pools[pool].slabs = slab;
+    pools[pool].bumpPtr = (char *)slab + SLAB_HEADER;
+    pools[pool].bumpEnd = (char *)slab + SLAB_SIZE;
+}
+
+// Helper function
+// Input ptr: A pooled object.
+// Return: The index of the object's slot within its slab.
+static size_t slotOf(void *ptr){
+    Slab *slab = (Slab *)blockOf(ptr);
+    return ((char *)ptr - ((char *)slab + SLAB_HEADER)) / pools[slab->block.pool].size;
+}
 
-    //adding the memNode to the memList
-    memNode->next = memList;
-    memList = memNode;
+// Input pool: The pool whose object size to use.
+// Return: A pointer to an uninitialized object in the slabs of that pool.
+// Objects of one pool are carved out of shared slabs so that they sit next to
+// each other in memory, and freed objects are reused first. The memory is
+// released by tfree like any other talloced memory.
+void *tallocTenured(poolClass pool){
+    Pool *p = &pools[pool];
+    p->count++;
+    poolBytes += p->size;
 
-    //returning the pointer to the allocated space on heap
+    // Reuse a released object if there is one
+    void *newptr;
+    if (p->freeList != NULL) {
+        FreeObject *obj = p->freeList;
+        p->freeList = obj->next;
+        newptr = obj;
+    }
+    else {
+        if ((size_t)(p->bumpEnd - p->bumpPtr) < p->size) {
+            newSlab(pool);
+        }
+        newptr = p->bumpPtr;
+        p->bumpPtr += p->size;
+    }
+
+    size_t slot = slotOf(newptr);
+    ((Slab *)blockOf(newptr))->used[slot / WORD_BITS] |= 1UL << (slot % WORD_BITS);
     return newptr;
 }
 
-// Frees all heap memory previously talloced (as well as any memory needed to 
+// Helper function
+// Moves the young bump pointer to the next nursery block, adding a block to
+// the end of the nursery if all of them are in use.
+static void nextNurseryBlock(){
+    Block *block = nurseryCurrent == NULL ? nurseryBlocks : nurseryCurrent->next;
+    if (block == NULL) {
+        block = newBlock(CHUNK_SIZE, NURSERY_BLOCK);
+        block->next = NULL;
+        if (nurseryCurrent == NULL) {
+            nurseryBlocks = block;
+        }
+        else {
+            nurseryCurrent->next = block;
+        }
+    }
+    nurseryCurrent = block;
+    youngPtr = (char *)block + CHUNK_HEADER;
+    youngEnd = (char *)block + CHUNK_SIZE;
+}
+
+// Input pool: The pool to allocate from.
+// Return: A pointer to an uninitialized object of the size that belongs to
+// that pool. New objects are bumped out of the nursery, and the collector
+// moves the ones that survive into the slabs of their pool (see
+// tallocTenured). If the nursery is disabled, the object goes straight to the
+// slabs.
+void *tallocPool(poolClass pool){
+    pools[pool].allocated++;
+    if (!nurseryEnabled) {
+        return tallocTenured(pool);
+    }
+    size_t size = pools[pool].size < YOUNG_MIN ? YOUNG_MIN : pools[pool].size;
+    if ((size_t)(youngEnd - youngPtr) < size) {
+        nextNurseryBlock();
+    }
+    void *newptr = youngPtr;
+    youngPtr += size;
+    youngBytes += size;
+    return newptr;
+}
+
+// Input ptr: Any pointer returned by talloc, tallocPool or tallocTenured.
+// Return: True if ptr is an object in the nursery.
+bool tallocIsYoung(void *ptr){
+    return blockOf(ptr)->pool == NURSERY_BLOCK;
+}
+
+// Return: The number of bytes handed out from the nursery since it was last
+// reset.
+size_t tnurseryBytes(){
+    return youngBytes;
+}
+
+// Input maxBytes: How much nursery memory to keep for the next young objects.
+// Empties the nursery, so that its memory is reused. Only the collector may
+// call this, once nothing points into the nursery anymore. Blocks beyond the
+// first maxBytes are given back to the system.
+void tnurseryReset(size_t maxBytes){
+    size_t keep = maxBytes / (CHUNK_SIZE - CHUNK_HEADER) + 1;
+    Block *block = nurseryBlocks;
+    for (size_t i = 1; block != NULL && i < keep; i++) {
+        block = block->next;
+    }
+    if (block != NULL) {
+        freeBlocks(block->next);
+        block->next = NULL;
+    }
+    nurseryCurrent = NULL;
+    youngPtr = NULL;
+    youngEnd = NULL;
+    youngBytes = 0;
+}
+
+// Input enabled: Whether new objects should go to the nursery.
+// With the nursery disabled, tallocPool behaves like tallocTenured. Only the
+// collector may call this, while the nursery is empty.
+void tnurserySetEnabled(bool enabled){
+    nurseryEnabled = enabled;
+}
+
+// Input pool: A pool.
+// Return: The size in bytes of the objects in that pool.
+size_t tpoolObjectSize(poolClass pool){
+    return pools[pool].size;
+}
+
+// Input capacity: The number of slots a frame needs, at most FRAME_SLOTS_MAX.
+// Return: The pool of the smallest frames with room for that many slots.
+poolClass tpoolForFrame(int capacity){
+    if (capacity <= 2) {
+        return FRAME_POOL;
+    }
+    return capacity <= 4 ? FRAME4_POOL : FRAME8_POOL;
+}
+
+// Input ptr: An object previously returned by tallocTenured(pool).
+// Input pool: The pool that ptr was allocated from.
+// Puts ptr on the free list of its pool so the next tallocPool can reuse it.
+void tpoolRelease(void *ptr, poolClass pool){
+    Pool *p = &pools[pool];
+    Slab *slab = (Slab *)blockOf(ptr);
+    assert(slab->block.pool == (int)pool);
+    size_t slot = slotOf(ptr);
+    slab->used[slot / WORD_BITS] &= ~(1UL << (slot % WORD_BITS));
+
+    FreeObject *obj = (FreeObject *)ptr;
+    obj->next = p->freeList;
+    p->freeList = obj;
+    p->count--;
+    poolBytes -= p->size;
+}
+
+// Input pool: A pool.
+// Return: The number of objects of that pool that currently live in its slabs.
+// Young objects in the nursery are not counted.
+size_t tpoolCount(poolClass pool){
+    return pools[pool].count;
+}
+
+// Return: The number of bytes taken by pooled objects that are currently
+// allocated, across all pools.
+size_t tpoolBytes(){
+    return poolBytes;
+}
+
+// Input ptr: Any pointer returned by talloc or tallocTenured.
+// Return: True if ptr is a pooled object that was not marked before. The object
+// is marked as a side effect. Memory from plain talloc is never collected, so
+// it is never marked and false is returned.
+bool tpoolMark(void *ptr){
+    Block *block = blockOf(ptr);
+    if (block->pool == ARENA_BLOCK) {
+        return false;
+    }
+    Slab *slab = (Slab *)block;
+    size_t slot = slotOf(ptr);
+    unsigned long bit = 1UL << (slot % WORD_BITS);
+    if (slab->marks[slot / WORD_BITS] & bit) {
+        return false;
+    }
+    slab->marks[slot / WORD_BITS] |= bit;
+    return true;
+}
+
+// Input ptr: Any pointer returned by talloc or tallocTenured.
+// Return: True if ptr is a pooled object that is marked. Memory from plain
+// talloc is never collected, so it counts as marked.
+bool tpoolIsMarked(void *ptr){
+    Block *block = blockOf(ptr);
+    if (block->pool == ARENA_BLOCK) {
+        return true;
+    }
+    Slab *slab = (Slab *)block;
+    size_t slot = slotOf(ptr);
+    return (slab->marks[slot / WORD_BITS] >> (slot % WORD_BITS)) & 1;
+}
+
+// Return: The number of pooled objects that were released.
+// Puts every pooled object that is allocated but not marked back on the free
+// list of its pool, then clears all marks for the next collection.
+size_t tpoolSweep(){
+    size_t released = 0;
+    for (int i = 0; i < NUM_POOLS; i++) {
+        Pool *p = &pools[i];
+        for (Slab *slab = p->slabs; slab != NULL; slab = (Slab *)slab->block.next) {
+            char *start = (char *)slab + SLAB_HEADER;
+            for (size_t w = 0; w < SLAB_BITS / WORD_BITS; w++) {
+                unsigned long dead = slab->used[w] & ~slab->marks[w];
+                slab->used[w] &= slab->marks[w];
+                slab->marks[w] = 0;
+                while (dead != 0) {
+                    int bit = __builtin_ctzl(dead);
+                    dead &= dead - 1;
+                    FreeObject *obj = (FreeObject *)(start + (w * WORD_BITS + bit) * p->size);
+                    obj->next = p->freeList;
+                    p->freeList = obj;
+                    p->count--;
+                    poolBytes -= p->size;
+                    released++;
+                }
+            }
+        }
+    }
+    return released;
+}
+
+// Input bytes: The most memory the heap may hold, or zero for no limit.
+// Once the limit is reached, the next request for more memory prints an
+// evaluation error and exits through texit.
+void tallocSetLimit(size_t bytes){
+    heapLimit = bytes;
+}
+
+// Return: What has been allocated since the program started, and how much
+// memory the heap holds.
+TallocStats tallocStats(){
+    TallocStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < NUM_TYPES; i++) {
+        stats.objects[i] = arenaObjects[i];
+        stats.objectBytes[i] = arenaObjectBytes[i];
+    }
+    stats.totalBytes = arenaBytes;
+    for (int i = 0; i < NUM_POOLS; i++) {
+        stats.objects[pools[i].type] += pools[i].allocated;
+        stats.objectBytes[pools[i].type] += pools[i].allocated * pools[i].size;
+        stats.totalBytes += pools[i].allocated * pools[i].size;
+    }
+    stats.heapBytes = heapBytes;
+    stats.peakHeapBytes = peakHeapBytes;
+    double seconds = (double)clock() / CLOCKS_PER_SEC;
+    stats.bytesPerSecond = seconds > 0 ? stats.totalBytes / seconds : 0;
+    return stats;
+}
+
+// Prints the allocation statistics to stderr.
+void tallocPrintStats(){
+    TallocStats stats = tallocStats();
+    for (int i = 0; i < NUM_TYPES; i++) {
+        if (stats.objects[i] > 0) {
+            fprintf(stderr, "%s: %zu objects, %zu bytes\n",
+                    typeName((objectType)i), stats.objects[i], stats.objectBytes[i]);
+        }
+    }
+    fprintf(stderr, "allocated: %zu bytes (%.1f MB/s)\n",
+            stats.totalBytes, stats.bytesPerSecond / (1024 * 1024));
+    fprintf(stderr, "heap: %zu bytes (peak %zu bytes)\n", stats.heapBytes, stats.peakHeapBytes);
+}
+
+// Everything one thread allocated, on its way to another thread.
+struct TallocHeap {
+    Block *chunks;
+    Slab *slabs[NUM_POOLS];
+    size_t count[NUM_POOLS];
+    size_t allocated[NUM_POOLS];
+    size_t poolBytes;
+    size_t arenaBytes;
+    size_t arenaObjects[NUM_TYPES];
+    size_t arenaObjectBytes[NUM_TYPES];
+    size_t heapBytes;
+};
+
+// Helper function
+// Input list: A list of blocks, or NULL.
+// Input rest: Another list of blocks.
+// Return: The blocks of list followed by those of rest.
+static Block *concatBlocks(Block *list, Block *rest){
+    if (list == NULL) {
+        return rest;
+    }
+    Block *last = list;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    last->next = rest;
+    return list;
+}
+
+// Return: Everything the calling thread has allocated, which the thread's
+// allocator forgets about. The nursery must be empty, so a thread that wants
+// to hand its objects over should turn it off first (tnurserySetEnabled).
+// Hand the result to tallocAdopt on another thread.
+TallocHeap *tallocDetach(){
+    assert(youngBytes == 0);
+    TallocHeap *heap = malloc(sizeof(TallocHeap));
+    if (heap == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+    heap->chunks = chunkList;
+    chunkList = NULL;
+    bumpPtr = NULL;
+    bumpEnd = NULL;
+    for (int i = 0; i < NUM_POOLS; i++) {
+        heap->slabs[i] = pools[i].slabs;
+        heap->count[i] = pools[i].count;
+        heap->allocated[i] = pools[i].allocated;
+        assert(pools[i].freeList == NULL);
+        pools[i].slabs = NULL;
+        pools[i].bumpPtr = NULL;
+        pools[i].bumpEnd = NULL;
+        pools[i].count = 0;
+        pools[i].allocated = 0;
+    }
+    heap->poolBytes = poolBytes;
+    poolBytes = 0;
+    heap->arenaBytes = arenaBytes;
+    arenaBytes = 0;
+    memcpy(heap->arenaObjects, arenaObjects, sizeof(arenaObjects));
+    memcpy(heap->arenaObjectBytes, arenaObjectBytes, sizeof(arenaObjectBytes));
+    memset(arenaObjects, 0, sizeof(arenaObjects));
+    memset(arenaObjectBytes, 0, sizeof(arenaObjectBytes));
+    heap->heapBytes = heapBytes;
+    heapBytes = 0;
+    return heap;
+}
+
+// Input heap: What another thread allocated, as returned from tallocDetach.
+// Makes the calling thread's allocator own everything in heap, as if it had
+// allocated it itself: pooled objects become old objects of the collector,
+// and tfree releases all of it.
+void tallocAdopt(TallocHeap *heap){
+    chunkList = concatBlocks(heap->chunks, chunkList);
+    for (int i = 0; i < NUM_POOLS; i++) {
+        pools[i].slabs = (Slab *)concatBlocks((Block *)heap->slabs[i], (Block *)pools[i].slabs);
+        pools[i].count += heap->count[i];
+        pools[i].allocated += heap->allocated[i];
+    }
+    poolBytes += heap->poolBytes;
+    arenaBytes += heap->arenaBytes;
+    for (int i = 0; i < NUM_TYPES; i++) {
+        arenaObjects[i] += heap->arenaObjects[i];
+        arenaObjectBytes[i] += heap->arenaObjectBytes[i];
+    }
+    heapBytes += heap->heapBytes;
+    if (heapBytes > peakHeapBytes) {
+        peakHeapBytes = heapBytes;
+    }
+    free(heap);
+}
+
+// Return: The size and alignment of the blocks that memory is handed out from.
+size_t tallocBlockSize(){
+    return CHUNK_SIZE;
+}
+
+// Return: How many bytes at the start of a block of memory that is never
+// collected its header takes (see tallocInitBlock).
+size_t tallocArenaHeader(){
+    return CHUNK_HEADER;
+}
+
+// Input block: Memory for a block of a heap image, aligned to tallocBlockSize.
+// Input size: The size of the block, a multiple of tallocBlockSize. Only a
+// block of memory that is never collected may span more than one.
+// Input pool: The pool whose objects go into the block, or NUM_POOLS for
+// memory that is never collected, like talloc's.
+// Return: Where in the block the first object may go. Objects in a pool's
+// block are placed with tallocBlockObject instead.
+size_t tallocInitBlock(void *block, size_t size, int pool){
+    Block *header = block;
+    header->next = NULL;
+    header->size = size;
+    header->pool = pool == NUM_POOLS ? ARENA_BLOCK : pool;
+    header->mapped = true;
+    if (pool == NUM_POOLS) {
+        return CHUNK_HEADER;
+    }
+    Slab *slab = block;
+    memset(slab->used, 0, sizeof(slab->used));
+    memset(slab->marks, 0, sizeof(slab->marks));
+    return SLAB_HEADER;
+}
+
+// Input block: A block of a pool, prepared with tallocInitBlock.
+// Input slot: The index of the object within the block.
+// Return: Where that object goes, or NULL if the block does not have that
+// many objects. The slot is marked as handed out.
+void *tallocBlockObject(void *block, size_t slot){
+    Slab *slab = block;
+    size_t size = pools[slab->block.pool].size;
+    if (SLAB_HEADER + (slot + 1) * size > SLAB_SIZE) {
+        return NULL;
+    }
+    slab->used[slot / WORD_BITS] |= 1UL << (slot % WORD_BITS);
+    return (char *)block + SLAB_HEADER + slot * size;
+}
+
+// Input blocks: The blocks of a heap image, one after the other, as prepared
+// with tallocInitBlock and mapped at a multiple of tallocBlockSize.
+// Input size: The number of bytes the blocks span.
+// Makes the allocator own the objects in the blocks as if it had allocated
+// them itself: pooled objects become old objects of the collector, which may
+// reclaim them like any other. The memory itself stays with the mapping;
+// tfree does not give it back.
+void tallocAddBlocks(void *blocks, size_t size){
+    char *ptr = blocks;
+    while (ptr < (char *)blocks + size) {
+        Block *block = (Block *)ptr;
+        ptr += block->size;
+        heapBytes += block->size;
+        if (block->pool == ARENA_BLOCK) {
+            block->next = chunkList;
+            chunkList = block;
+            continue;
+        }
+        Pool *p = &pools[block->pool];
+        Slab *slab = (Slab *)block;
+        size_t count = 0;
+        for (size_t w = 0; w < SLAB_BITS / WORD_BITS; w++) {
+            count += __builtin_popcountl(slab->used[w]);
+        }
+        block->next = (Block *)p->slabs;
+        p->slabs = slab;
+        p->count += count;
+        poolBytes += count * p->size;
+    }
+    if (heapBytes > peakHeapBytes) {
+        peakHeapBytes = heapBytes;
+    }
+}
+
+// Input blocks: The blocks of a heap image, before they are passed to
+// tallocAddBlocks.
+// Input size: The number of bytes the blocks span.
+// Input obj: Any address.
+// Return: The pool of the block that obj is in, if obj is an object that was
+// handed out in it (see tallocBlockObject); -1 if obj is anywhere else, such
+// as between objects or in memory that is never collected, or if the blocks
+// are damaged.
+int tallocBlockPool(void *blocks, size_t size, void *obj){
+    char *ptr = blocks;
+    char *end = ptr + size;
+    if ((char *)obj < ptr || (char *)obj >= end) {
+        return -1;
+    }
+    for (;;) {
+        Block *block = (Block *)ptr;
+        if (block->size == 0 || block->size % CHUNK_SIZE != 0 || block->size > (size_t)(end - ptr)) {
+            return -1;
+        }
+        if ((char *)obj < ptr + block->size) {
+            break;
+        }
+        ptr += block->size;
+    }
+    Block *block = (Block *)ptr;
+    if (block->pool < 0 || block->pool >= NUM_POOLS || block->size != SLAB_SIZE) {
+        return -1;
+    }
+    size_t objectSize = pools[block->pool].size;
+    size_t offset = (char *)obj - ptr;
+    if (offset < SLAB_HEADER || (offset - SLAB_HEADER) % objectSize != 0
+            || offset + objectSize > SLAB_SIZE) {
+        return -1;
+    }
+    size_t slot = (offset - SLAB_HEADER) / objectSize;
+    Slab *slab = (Slab *)block;
+    if ((slab->used[slot / WORD_BITS] & (1UL << (slot % WORD_BITS))) == 0) {
+        return -1;
+    }
+    return block->pool;
+}
+
+// Frees all heap memory previously talloced (as well as any memory needed to
 // administer that memory).
 void tfree(){
-    MemNode *current = memList;
-    while (current != NULL) {
-        MemNode *nextNode = current->next;
-        free(current->ptr);
-        free(current);    
-        current = nextNode;
+    freeBlocks(chunkList);
+    chunkList = NULL;
+    bumpPtr = NULL;
+    bumpEnd = NULL;
+
+    freeBlocks(nurseryBlocks);
+    nurseryBlocks = NULL;
+    nurseryCurrent = NULL;
+    youngPtr = NULL;
+    youngEnd = NULL;
+    youngBytes = 0;
+
+    for (int i = 0; i < NUM_POOLS; i++) {
+        freeBlocks((Block *)pools[i].slabs);
+        pools[i].slabs = NULL;
+        pools[i].freeList = NULL;
+        pools[i].bumpPtr = NULL;
+        pools[i].bumpEnd = NULL;
+        pools[i].count = 0;
     }
-    memList = NULL; 
+    poolBytes = 0;
 }
 
 // Input status: A C error code. Zero if no error, non-zero if error.
@@ -51,4 +736,4 @@ void tfree(){
 void texit(int status){
     tfree();
     exit(status);
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include "object.h"
 
 #ifndef _TALLOC
@@ -13,6 +14,12 @@
 // allocated heap memory in a data structure, such that tfree can free it later.
 void *talloc(size_t size);
 
+// Input type: The type of the object.
+// Input size: The size of the object in bytes.
+// Return: Memory for an object that is never collected, like talloc. The object
+// is counted by tallocStats under its type.
+void *tallocObject(objectType type, size_t size);
+
 // Frees all heap memory previously talloced (as well as any memory needed to 
 // administer that memory).
 void tfree();
@@ -21,5 +28,171 @@ void tfree();
 // A replacement for the built-in C function exit. Calls tfree and then exit.
 void texit(int status);
 
+// The fixed-size objects that the interpreter allocates over and over. Each of
+// them gets a pool of its own (see tallocPool). Pooled objects are the ones the
+// garbage collector (gc.h) can reclaim. Booleans, the empty list and most
+// integers are immediates (see object.h) and are never allocated at all.
+typedef enum {
+    CONS_POOL, INT_POOL, DOUBLE_POOL, FRAME_POOL, FRAME4_POOL, FRAME8_POOL,
+    CLOSURE_POOL, NUM_POOLS
+} poolClass;
+
+// Input pool: The pool to allocate from.
+// Return: A pointer to an uninitialized object of the size that belongs to
+// that pool. New objects are bumped out of the nursery, and the collector
+// moves the ones that survive into the slabs of their pool (see
+// tallocTenured). If the nursery is disabled, the object goes straight to the
+// slabs.
+void *tallocPool(poolClass pool);
+
+// Input pool: The pool whose object size to use.
+// Return: A pointer to an uninitialized object in the slabs of that pool.
+// Objects of one pool are carved out of shared slabs so that they sit next to
+// each other in memory, and freed objects are reused first. The memory is
+// released by tfree like any other talloced memory.
+void *tallocTenured(poolClass pool);
+
+// Counters of everything allocated since the program started. Objects are
+// counted by type whether they were collected since or not; totalBytes also
+// includes memory that is not an object, such as the text of strings.
+typedef struct TallocStats {
+    size_t objects[NUM_TYPES];
+    size_t objectBytes[NUM_TYPES];
+    size_t totalBytes;
+    size_t heapBytes;           // memory currently held from the system
+    size_t peakHeapBytes;       // the most heapBytes has ever been
+    double bytesPerSecond;      // totalBytes per second of processor time
+} TallocStats;
+
+// Return: What has been allocated since the program started, and how much
+// memory the heap holds.
+TallocStats tallocStats();
+
+// Prints the allocation statistics to stderr.
+void tallocPrintStats();
+
+// Everything one thread allocated, on its way to another thread. Each thread
+// has an allocator of its own; only the thread that runs the interpreter
+// collects garbage.
+typedef struct TallocHeap TallocHeap;
+
+// Return: Everything the calling thread has allocated, which the thread's
+// allocator forgets about. The nursery must be empty, so a thread that wants
+// to hand its objects over should turn it off first (tnurserySetEnabled).
+// Hand the result to tallocAdopt on another thread.
+TallocHeap *tallocDetach();
+
+// Input heap: What another thread allocated, as returned from tallocDetach.
+// Makes the calling thread's allocator own everything in heap, as if it had
+// allocated it itself: pooled objects become old objects of the collector,
+// and tfree releases all of it.
+void tallocAdopt(TallocHeap *heap);
+
+// A heap image (see image.c) holds objects in blocks of the same layout as
+// the allocator's own, so that it can be mapped into memory and used as it is.
+
+// Return: The size and alignment of the blocks that memory is handed out from.
+size_t tallocBlockSize();
+
+// Return: How many bytes at the start of a block of memory that is never
+// collected its header takes (see tallocInitBlock).
+size_t tallocArenaHeader();
+
+// Input block: Memory for a block of a heap image, aligned to tallocBlockSize.
+// Input size: The size of the block, a multiple of tallocBlockSize. Only a
+// block of memory that is never collected may span more than one.
+// Input pool: The pool whose objects go into the block, or NUM_POOLS for
+// memory that is never collected, like talloc's.
+// Return: Where in the block the first object may go. Objects in a pool's
+// block are placed with tallocBlockObject instead.
+size_t tallocInitBlock(void *block, size_t size, int pool);
+
+// Input block: A block of a pool, prepared with tallocInitBlock.
+// Input slot: The index of the object within the block.
+// Return: Where that object goes, or NULL if the block does not have that
+// many objects. The slot is marked as handed out.
+void *tallocBlockObject(void *block, size_t slot);
+
+// Input blocks: The blocks of a heap image, one after the other, as prepared
+// with tallocInitBlock and mapped at a multiple of tallocBlockSize.
+// Input size: The number of bytes the blocks span.
+// Makes the allocator own the objects in the blocks as if it had allocated
+// them itself: pooled objects become old objects of the collector, which may
+// reclaim them like any other. The memory itself stays with the mapping;
+// tfree does not give it back.
+void tallocAddBlocks(void *blocks, size_t size);
+
+// Input blocks: The blocks of a heap image, before they are passed to
+// tallocAddBlocks.
+// Input size: The number of bytes the blocks span.
+// Input obj: Any address.
+// Return: The pool of the block that obj is in, if obj is an object that was
+// handed out in it (see tallocBlockObject); -1 if obj is anywhere else, such
+// as between objects or in memory that is never collected, or if the blocks
+// are damaged.
+int tallocBlockPool(void *blocks, size_t size, void *obj);
+
+// Input bytes: The most memory the heap may hold, or zero for no limit.
+// Once the limit is reached, the next request for more memory prints an
+// evaluation error and exits through texit.
+void tallocSetLimit(size_t bytes);
+
+// Input ptr: Any pointer returned by talloc, tallocPool or tallocTenured.
+// Return: True if ptr is an object in the nursery.
+bool tallocIsYoung(void *ptr);
+
+// Return: The number of bytes handed out from the nursery since it was last
+// reset.
+size_t tnurseryBytes();
+
+// Input maxBytes: How much nursery memory to keep for the next young objects.
+// Empties the nursery, so that its memory is reused. Only the collector may
+// call this, once nothing points into the nursery anymore. Blocks beyond the
+// first maxBytes are given back to the system.
+void tnurseryReset(size_t maxBytes);
+
+// Input enabled: Whether new objects should go to the nursery.
+// With the nursery disabled, tallocPool behaves like tallocTenured. Only the
+// collector may call this, while the nursery is empty.
+void tnurserySetEnabled(bool enabled);
+
+// Input pool: A pool.
+// Return: The size in bytes of the objects in that pool.
+size_t tpoolObjectSize(poolClass pool);
+
+// Input capacity: The number of slots a frame needs, at most FRAME_SLOTS_MAX.
+// Return: The pool of the smallest frames with room for that many slots.
+poolClass tpoolForFrame(int capacity);
+
+// Input ptr: An object previously returned by tallocTenured(pool).
+// Input pool: The pool that ptr was allocated from.
+// Puts ptr on the free list of its pool so the next tallocPool can reuse it.
+void tpoolRelease(void *ptr, poolClass pool);
+
+// Input pool: A pool.
+// Return: The number of objects of that pool that currently live in its slabs.
+// Young objects in the nursery are not counted.
+size_t tpoolCount(poolClass pool);
+
+// Return: The number of bytes taken by pooled objects that are currently
+// allocated, across all pools.
+size_t tpoolBytes();
+
+// Input ptr: Any pointer returned by talloc or tallocTenured.
+// Return: True if ptr is a pooled object that was not marked before. The object
+// is marked as a side effect. Memory from plain talloc is never collected, so
+// it is never marked and false is returned.
+bool tpoolMark(void *ptr);
+
+// Input ptr: Any pointer returned by talloc or tallocTenured.
+// Return: True if ptr is a pooled object that is marked. Memory from plain
+// talloc is never collected, so it counts as marked.
+bool tpoolIsMarked(void *ptr);
+
+// Return: The number of pooled objects that were released.
+// Puts every pooled object that is allocated but not marked back on the free
+// list of its pool, then clears all marks for the next collection.
+size_t tpoolSweep();
+
 #endif
 
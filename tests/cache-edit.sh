@@ -0,0 +1,17 @@
+#!/bin/sh
+# Usage: tests/cache-edit.sh INTERPRETER
+# An edit to a program must invalidate its --ast-cache file. The two
+# programs differ in only two characters, which a weak hash of the source
+# once mapped to the same value, so the cache ran the old program.
+bin=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+printf '(quote aaaaaaaadaaaaaaaaaaaaaaaaaaaaa)\n(quote bxbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb)\n' > "$work/p.scm"
+"$bin" --ast-cache "$work/p.scm" > /dev/null
+printf '(quote aaaaaaaagaaaaaaaaaaaaaaaaaaaaa)\n(quote babbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb)\n' > "$work/p.scm"
+cached=$("$bin" --ast-cache "$work/p.scm")
+parsed=$("$bin" "$work/p.scm")
+if [ "$cached" != "$parsed" ]; then
+    echo "cache-edit: the cache ran the program as it was before the edit"
+    exit 1
+fi
@@ -0,0 +1,43 @@
+; Programs that every engine must run alike: closures that capture locals at
+; several depths, lets, map, locals that shadow other locals, globals and
+; primitives, and a malformed form at the end, which stops the program.
+(define make-adder (lambda (n) (lambda (x) (+ x n))))
+(define add5 (make-adder 5))
+(add5 10)
+((make-adder 1.5) 2)
+(define curry3 (lambda (a) (lambda (b) (lambda (c) (cons a (cons b (cons c (quote ()))))))))
+(((curry3 1) 2) 3)
+(define pairs (lambda (a b) (let ((first (lambda () a)) (second (lambda () b))) (cons (first) (second)))))
+(pairs 1 2)
+(let ((x 1) (y 2)) (let ((x y) (y x)) (cons x y)))
+(let ((x 1)) (let ((f (lambda (y) (+ x y)))) (let ((x 100)) (f 10))))
+(let ((car cdr)) (car (quote (1 2 3))))
+(car (quote (1 2 3)))
+(define shadow (lambda (list) (let ((list (cdr list))) (car list))))
+(shadow (quote (1 2 3)))
+(let () 1 2 3)
+(let ((a 1)) (define b 2) (+ a b))
+(let ((v (quote (a b c)))) v)
+(map add5 (quote (1 2 3)))
+(map (lambda (x) (let ((y (+ x x))) (cons x y))) (quote (1 2 3)))
+(map (make-adder 10) (map (lambda (x) (+ x 1)) (quote (0 1 2))))
+(map (lambda (f) (f 1)) (map make-adder (quote (1 2 3))))
+(define len (lambda (l n) (if (null? l) n (len (cdr l) (+ n 1)))))
+(len (quote (1 2 3 4 5 6 7)) 0)
+(define sum (lambda (l) (if (null? l) 0 (+ (car l) (sum (cdr l))))))
+(sum (quote (1 2 3 4 5)))
+(define counter (lambda (n) (if (null? n) (quote done) (let ((rest (cdr n))) (counter rest)))))
+(counter (quote (1 2 3)))
+(define twice (lambda (f) (lambda (x) (f (f x)))))
+((twice (twice add5)) 0)
+((twice cdr) (quote (1 2 3)))
+(define deep (lambda (a) (lambda (b) (let ((c (+ a b))) (lambda (d) (let ((e (+ c d))) (+ a b c d e)))))))
+(((deep 1) 2) 3)
+(if (null? (quote ())) (quote yes) (quote no))
+(if #f #f)
+(cons 1.5 "text")
+(define x 7)
+(let ((f (lambda () x))) (define x 8) (f))
+x
+(let ((x 1) (x 2)) x)
+(quote never-reached)
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Usage: tests/gc-threshold.sh INTERPRETER
+# A lower --gc-threshold must make more major collections, and the programs
+# must print the same whatever the threshold is.
+bin=$1
+dir=$(dirname "$0")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cat > "$work/garbage.scm" <<'SCM'
+(define double (lambda (list acc) (if (null? list) acc (double (cdr list) (cons 1 (cons 1 acc))))))
+(define grow (lambda (list times) (if (null? times) list (grow (double list (quote ())) (cdr times)))))
+(define l (grow (quote (1)) (quote (1 1 1 1 1 1 1 1 1 1))))
+(define maps (lambda (k) (if (null? k) (quote done) (let ((result (map (lambda (x) (cons x x)) l))) (maps (cdr k))))))
+(maps l)
+SCM
+collections() {
+    "$bin" --nursery=0 --gc-stats "$@" "$work/garbage.scm" 2>&1 \
+        | sed -n 's/^major collections: \([0-9]*\).*/\1/p'
+}
+failed=0
+for threshold in 65536 65536,150 1000000000,400; do
+    for program in "$dir"/engines.scm "$dir"/jit.scm; do
+        if ! "$bin" --nursery=0 --gc-threshold=$threshold "$program" 2>&1 | cmp -s - "${program%.scm}.exp"; then
+            echo "gc-threshold: $program printed something else with --gc-threshold=$threshold"
+            failed=1
+        fi
+    done
+done
+few=$(collections --gc-threshold=1000000000)
+many=$(collections --gc-threshold=65536,150)
+if [ -z "$few" ] || [ -z "$many" ] || [ "$many" -le "$few" ]; then
+    echo "gc-threshold: a lower threshold did not collect more often ($many against $few)"
+    failed=1
+fi
+exit $failed
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Usage: tests/image-frame.sh INTERPRETER
+# A heap image whose global frame points anywhere but at a frame it holds must
+# be turned down as damaged, not crash the interpreter.
+bin=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+echo '(define x 1)' > "$work/define.scm"
+echo 'x' > "$work/use.scm"
+"$bin" --dump-image="$work/x.img" "$work/define.scm" > /dev/null
+# The words of the header, in order. The first one from the base up is the
+# global frame, since the block and pool sizes before it are all small.
+words=$(od -A n -t u8 -N 512 -v "$work/x.img" | tr -s ' ' '\n' | sed '/^$/d')
+base=$(echo "$words" | sed -n 2p)
+blockSize=$(echo "$words" | sed -n 3p)
+index=$(echo "$words" | awk -v base=$base 'NR > 3 && $1 >= base { print NR - 1; exit }')
+failed=0
+for frame in 0 $base $((base + blockSize)) $((base + blockSize + 8)) $((base + blockSize * 4096)); do
+    cp "$work/x.img" "$work/bad.img"
+    bytes=""
+    for i in 0 1 2 3 4 5 6 7; do
+        bytes="$bytes$(printf '\\%03o' $(((frame >> (8 * i)) & 255)))"
+    done
+    printf "$bytes" | dd of="$work/bad.img" bs=8 seek=$index conv=notrunc 2> /dev/null
+    "$bin" --image="$work/bad.img" "$work/use.scm" > "$work/actual" 2>&1
+    status=$?
+    if [ $status -ne 1 ] || ! grep -q "is not a heap image" "$work/actual"; then
+        echo "image-frame: a global frame at $frame was not turned down (status $status)"
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Usage: tests/image-long-text.sh INTERPRETER
+# Strings long enough to get a block of their own in a heap image must come
+# back whole. The lengths are around the size of a block, where the text
+# once ran past the end of its block into the header of the next one.
+bin=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+echo 's' > "$work/use.scm"
+failed=0
+for length in 65500 65514 65520 65526 65530 131049 131060; do
+    awk -v n=$length -v define="$work/define.scm" -v expected="$work/expected" 'BEGIN {
+        text = "";
+        for (i = 0; i < n; i++) {
+            text = text sprintf("%c", 97 + i % 26);
+        }
+        printf "(define s \"%s\")\n", text > define;
+        printf "\"%s\"\n", text > expected;
+    }'
+    "$bin" --dump-image="$work/s.img" "$work/define.scm" > /dev/null
+    "$bin" --image="$work/s.img" "$work/use.scm" > "$work/actual"
+    if ! cmp -s "$work/actual" "$work/expected"; then
+        echo "image-long-text: a string of $length characters changed in the image"
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,44 @@
+; The cases the machine code of --jit handles on its own, each run through a
+; function that is called several times so that it is compiled first: + on
+; fixnums and where it has to fall back on the primitive, car and cdr on
+; pairs, a name of a primitive bound to something else, lets whose values
+; are held while the collector runs, and tail calls out of machine code. It
+; ends with car on a number, which must fail as it does when interpreted.
+(define three (quote (1 2 3)))
+(define add (lambda (a b) (+ a b)))
+(map (lambda (x) (add x 10)) three)
+(map (lambda (x) (add 2147483647 x)) three)
+(map (lambda (x) (add -2147483648 (+ -1 (+ x -1)))) three)
+(map (lambda (x) (add x 0.5)) three)
+(map (lambda (x) (+ x x x x)) three)
+(map (lambda (x) (+)) three)
+(map (lambda (x) (+ 1073741824 1073741823 x)) three)
+(map (lambda (x) (car (cons x (quote ())))) three)
+(map (lambda (x) (cdr (cons 0 x))) three)
+(map (lambda (x) (null? (cdr (cons x (quote ()))))) three)
+(map (lambda (x) (null? x)) three)
+(define rebound (lambda (x) (define car cdr) (car x)))
+(map (lambda (x) (rebound three)) three)
+(define renamed (lambda (car) (car three)))
+(map (lambda (x) (renamed cdr)) three)
+(define garbage
+  (lambda (n acc)
+    (if (null? n)
+        acc
+        (let ((a (cons 1 (cons 2 (quote ()))))
+              (b (map (lambda (x) (cons x x)) three))
+              (c (cons acc acc)))
+          (let ((d (map (lambda (x) (cons x a)) b)))
+            (garbage (cdr n) (add (car (car (car d))) (car (cdr a)))))))))
+(define times10
+  (lambda (src acc)
+    (if (null? src)
+        acc
+        (times10 (cdr src) (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 acc))))))))))))))
+(define thousand (times10 (times10 (times10 (quote (0)) (quote ())) (quote ())) (quote ())))
+(garbage thousand 0)
+(define count (lambda (list n) (if (null? list) n (let ((next (cdr list))) (count next (+ n 1))))))
+(count (times10 (times10 thousand (quote ())) (quote ())) 0)
+(define first (lambda (x) (car x)))
+(first three)
+(first 5)
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Usage: tests/malformed.sh INTERPRETER
+# Every engine must turn down the same malformed special forms. Each one
+# stops the program, so each gets a run of its own on each engine, after a
+# line that shows the program got that far.
+bin=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+while read -r form; do
+    printf '1\n%s\n2\n' "$form" > "$work/program.scm"
+    for engine in --engine=ast --engine=vm --engine=nodes --jit=1 "--jit=1 --nursery=4096"; do
+        output=$("$bin" $engine "$work/program.scm" 2>&1)
+        if [ "$output" != "$(printf '1\nEvaluation error')" ]; then
+            echo "malformed: $form was not turned down with $engine"
+            failed=1
+        fi
+    done
+done <<'FORMS'
+(if)
+(if 1)
+(if 1 2 3 4)
+(let)
+(let x 1)
+(let ((x)) x)
+(let ((1 2)) 1)
+(let ((x 1) (x 2)) x)
+(quote)
+(quote 1 2)
+(define)
+(define x)
+(define 1 2)
+(define x 1 2)
+(lambda)
+(lambda (x))
+(lambda (x 1) x)
+(lambda (x x) x)
+((lambda (x) x))
+((lambda (x) x) 1 2)
+(1 2)
+undefined-name
+(car (quote ()))
+(let ((f (lambda (x) (car x)))) (f 5))
+(let ((f (lambda (x) (car x)))) (f (quote (1))) (f 5))
+(let ((f (lambda (x) (cdr x)))) (f (quote (1))) (f 5))
+(let ((f (lambda (x y) (+ x y)))) (f 1 2) (f 1 (quote ())))
+FORMS
+exit $failed
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Usage: tests/run.sh INTERPRETER
+# Runs every tests/*.scm on every engine and compares what it prints with
+# tests/*.exp, then runs every tests/*.sh, which check what takes more than
+# one run of the interpreter. Prints the tests that fail and exits with 1 if any did.
+# Build the interpreter first:
+#   gcc -std=c11 -O2 *.c -o interpreter -pthread
+bin=${1:?usage: $0 INTERPRETER}
+case $bin in
+    /*) ;;
+    *) bin=$(pwd)/$bin ;;
+esac
+dir=$(dirname "$0")
+failed=0
+for program in "$dir"/*.scm; do
+    [ -e "$program" ] || continue
+    for engine in --engine=ast --engine=vm --engine=nodes --jit=1 "--jit=1 --nursery=4096"; do
+        if ! "$bin" $engine "$program" 2>&1 | cmp -s - "${program%.scm}.exp"; then
+            echo "FAIL $program $engine"
+            failed=1
+        fi
+    done
+done
+for script in "$dir"/*.sh; do
+    [ "$(basename "$script")" = run.sh ] && continue
+    if ! sh "$script" "$bin"; then
+        echo "FAIL $script"
+        failed=1
+    fi
+done
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
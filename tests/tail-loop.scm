@@ -0,0 +1,19 @@
+; A loop of a million iterations written as tail recursion, through an if and
+; a let. It must run in constant C stack rather than overflow it.
+(define times10
+  (lambda (src acc)
+    (if (null? src)
+        acc
+        (times10 (cdr src) (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 (cons 0 acc))))))))))))))
+(define grow
+  (lambda (list times)
+    (if (null? times)
+        list
+        (grow (times10 list (quote ())) (cdr times)))))
+(define count
+  (lambda (list n)
+    (if (null? list)
+        n
+        (let ((next (cdr list)))
+          (count next (+ n 1))))))
+(count (grow (quote (0 0 0 0 0 0 0 0 0 0)) (quote (1 1 1 1 1))) 0)
@@ -1,25 +1,29 @@
 // tokenizer.c by Leon Liang
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "object.h"
 #include "talloc.h"
 #include "linkedlist.h"
+#include "symbol.h"
 #include "tokenizer.h"
 
-// Helper function
-// Return: A newly allocated Object of INT_TYPE.
-Integer *makeIntToken(){
-    Integer *intObj = (Integer *)talloc(sizeof(Integer));
-    intObj->type = INT_TYPE;
-    return (Integer *)intObj;
-}
-
 // Helper function
 // Return: A newly allocated Object of DOUBLE_TYPE.
 Double *makeDoubleToken(){
-    Double *doubleObj = (Double *)talloc(sizeof(Double));
+    Double *doubleObj = (Double *)tallocPool(DOUBLE_POOL);
     doubleObj->type = DOUBLE_TYPE;
     return (Double *)doubleObj;
 }
@@ -27,126 +31,481 @@ Double *makeDoubleToken(){
 // Helper function
 // Return: A newly allocated Object of STR_TYPE.
 String *makeStringToken(){
-    String *strObj = (String *)talloc(sizeof(String));
+    String *strObj = (String *)tallocObject(STR_TYPE, sizeof(String));
     strObj->type = STR_TYPE;
     return (String *)strObj;
 }
 
+// Input that is not a regular file is read in blocks of this size.
+#define READ_BLOCK (64 * 1024)
+
+// Where the tokenizer gets its characters from. A regular file is mapped into
+// memory as a whole; anything else (a pipe, a terminal) is read in large
+// blocks. Either way, getting the next character is usually just a pointer
+// increment rather than a call to fgetc.
+typedef struct Reader {
+    const unsigned char *ptr;     // the next character
+    const unsigned char *end;     // one past the last character available
+    int fd;                       // where to read the next block from
+    unsigned char *block;         // the block buffer, or NULL if mapped
+    void *map;                    // the mapped file, or NULL if read in blocks
+    size_t mapSize;
+} Reader;
+
 // Helper function
-// Return: A newly allocated Object of BOOL_TYPE.
-Boolean *makeBooleanToken(){
-    Boolean *boolObj = (Boolean *)talloc(sizeof(Boolean));
-    boolObj->type = BOOL_TYPE;
-    return (Boolean *)boolObj;
+// Input reader: A Reader.
+// Input fd: An open file descriptor, positioned where the program starts.
+// Prepares reader to read everything from fd.
+static void readerOpen(Reader *reader, int fd){
+    memset(reader, 0, sizeof(Reader));
+    reader->fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && lseek(fd, 0, SEEK_CUR) == 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            reader->map = map;
+            reader->mapSize = st.st_size;
+            reader->ptr = map;
+            reader->end = reader->ptr + st.st_size;
+            return;
+        }
+    }
+    reader->block = malloc(READ_BLOCK);
+    if (reader->block == NULL) {
+        printf("Syntax error: out of memory\n");
+        texit(1);
+    }
 }
 
 // Helper function
-// Return: A newly allocated Object of SYMBOL_TYPE.
-Symbol *makeSymbolToken(){
-    Symbol *symbolObj = (Symbol *)talloc(sizeof(Symbol));
-    symbolObj->type = SYMBOL_TYPE;
-    return (Symbol *)symbolObj;
+// Input reader: A Reader that has no characters left in memory.
+// Return: The next character, or EOF at the end of the input.
+static int readerRefill(Reader *reader){
+    if (reader->block == NULL) {
+        return EOF;
+    }
+    // Whatever has been printed so far should be visible while read waits
+    // for more input, e.g. the results of a streamed program
+    fflush(stdout);
+    ssize_t count;
+    do {
+        count = read(reader->fd, reader->block, READ_BLOCK);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+        return EOF;
+    }
+    reader->ptr = reader->block;
+    reader->end = reader->block + count;
+    return *reader->ptr++;
 }
 
 // Helper function
-// Return: A newly allocated Object of OPEN_TYPE.
-Object *makeOpenToken(){
-    Object *openObj = (Object *)talloc(sizeof(Object));
-    openObj->type = OPEN_TYPE;
-    return (Object *)openObj;
+// Input reader: A Reader.
+// Return: The next character as an unsigned char, or EOF at the end of the
+// input, just like fgetc.
+static inline int nextChar(Reader *reader){
+    if (reader->ptr < reader->end) {
+        return *reader->ptr++;
+    }
+    return readerRefill(reader);
 }
 
 // Helper function
-// Return: A newly allocated Object of CLOSE_TYPE.
-Object *makeCloseToken(){
-    Object *closeObj = (Object *)talloc(sizeof(Object));
-    closeObj->type = CLOSE_TYPE;
-    return (Object *)closeObj;
+// Input reader: A Reader.
+// Gives back the memory of reader. Tokens never point into it.
+static void readerClose(Reader *reader){
+    if (reader->map != NULL) {
+        munmap(reader->map, reader->mapSize);
+    }
+    free(reader->block);
 }
 
+// The class of every character, as a set of the bits below. They agree with
+// isspace, and with the isalpha/isalnum/strchr tests the tokenizer used to do
+// for symbols, including the quirk that '\0' counts as a symbol character.
+#define CHAR_SPACE 1          // whitespace
+#define CHAR_SYMBOL_START 2   // may start a symbol
+#define CHAR_SYMBOL 4         // may appear after the start of a symbol
+
+static const unsigned char charClass[256] = {
+    6, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 6, 0, 0, 6, 6, 6, 0, 0, 0, 6, 4, 0, 4, 0, 6,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 6, 0, 6, 6, 6, 6,
+    0, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0, 0, 0, 6, 6,
+    0, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 0, 0, 0, 6, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 // Helper function
-// Return: A newly allocated Object of CLOSEBRACE_TYPE.
-Object *makeCloseBraceToken(){
-    Object *closeBraceObj = (Object *)talloc(sizeof(Object));
-    closeBraceObj->type = CLOSEBRACE_TYPE;
-    return (Object *)closeBraceObj;
+// Input ptr: The first character to look at.
+// Input end: One past the last character to look at.
+// Return: The first character in [ptr, end) that is not whitespace, or end.
+static const unsigned char *skipSpace(const unsigned char *ptr, const unsigned char *end){
+#ifdef __SSE2__
+    // Whitespace is ' ' or a character from '\t' to '\r'
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i range = _mm_set1_epi8('\r' - '\t');
+    while (end - ptr >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)ptr);
+        __m128i offset = _mm_sub_epi8(chunk, tab);
+        __m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(offset, range), offset);
+        __m128i isSpace = _mm_or_si128(isControl, _mm_cmpeq_epi8(chunk, space));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(isSpace) & 0xffff;
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 16;
+    }
+#endif
+    while (ptr < end && (charClass[*ptr] & CHAR_SPACE)) {
+        ptr++;
+    }
+    return ptr;
 }
 
 // Helper function
-// Return: A newly allocated Object of CONS_TYPE.
-ConsCell *makeConsCellToken(){
-    ConsCell *conObj = (ConsCell *)talloc(sizeof(ConsCell));
-    conObj->type = CONS_TYPE;
-    return (ConsCell *)conObj;
+// Input ptr: The first character to look at.
+// Input end: One past the last character to look at.
+// Input target: The character to look for.
+// Return: The first occurrence of target in [ptr, end), or end.
+static const unsigned char *findChar(const unsigned char *ptr, const unsigned char *end,
+                                     unsigned char target){
+#ifdef __SSE2__
+    const __m128i wanted = _mm_set1_epi8((char)target);
+    while (end - ptr >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)ptr);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, wanted));
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 16;
+    }
+#endif
+    while (ptr < end && *ptr != target) {
+        ptr++;
+    }
+    return ptr;
 }
 
+// The characters of the token being read. The buffer starts out on the C heap
+// with room for TOKEN_BUFFER_SIZE characters and doubles whenever it is full,
+// so tokens of any length fit.
+#define TOKEN_BUFFER_SIZE 256
 
+typedef struct TokenBuffer {
+    char *data;
+    size_t length;                // characters in the token so far
+    size_t capacity;              // room in data, not counting the final '\0'
+} TokenBuffer;
 
-// Return: A cons cell that is the head of a list. The list consists of the 
-// tokens read from standard input (stdin).
-Object *tokenize(){
-    int ch;                       // int, not char; see fgetc documentation
-    char buffer[300 + 1];         // based on 300-char limit plus terminating \0
-    int index = 0;                // where in buffer to place the next char read
+// Helper function
+// Input buffer: A TokenBuffer.
+// Input needed: How many characters must fit in it.
+// Grows buffer until it has room for needed characters and a '\0'.
+static void bufferReserve(TokenBuffer *buffer, size_t needed){
+    if (needed <= buffer->capacity) {
+        return;
+    }
+    size_t capacity = buffer->capacity == 0 ? TOKEN_BUFFER_SIZE : buffer->capacity;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity + 1);
+    if (data == NULL) {
+        printf("Syntax error: out of memory\n");
+        texit(1);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+}
+
+// Helper function
+// Input buffer: A TokenBuffer.
+// Input ch: A character.
+// Appends ch to the token in buffer.
+static inline void bufferPush(TokenBuffer *buffer, int ch){
+    if (buffer->length == buffer->capacity) {
+        bufferReserve(buffer, buffer->length + 1);
+    }
+    buffer->data[buffer->length++] = (char)ch;
+}
+
+// Helper function
+// Input buffer: A TokenBuffer.
+// Input chars: The characters to append.
+// Input count: How many characters to append.
+// Appends count characters to the token in buffer.
+static void bufferAppend(TokenBuffer *buffer, const unsigned char *chars, size_t count){
+    bufferReserve(buffer, buffer->length + count);
+    memcpy(buffer->data + buffer->length, chars, count);
+    buffer->length += count;
+}
+
+// Helper function
+// Input buffer: A TokenBuffer.
+// Return: The token in buffer as a C string, for atoi and atof.
+static char *bufferTerminate(TokenBuffer *buffer){
+    bufferReserve(buffer, buffer->length);
+    buffer->data[buffer->length] = '\0';
+    return buffer->data;
+}
+
+// Tokenizer.ch holds this while the character after the last token has not
+// been read yet. Single-character tokens leave it there, so that nextToken
+// returns them without waiting for more input.
+#define NO_CHAR (-2)
+
+// The state of the tokenizer between two calls to nextToken.
+struct Tokenizer {
+    Reader reader;
+    TokenBuffer buffer;           // the token being read
+    int ch;                       // the next character, EOF or NO_CHAR
+    int fd;                       // the file to close, or -1 for none
+    bool recover;                 // whether errors end the input, not the program
+    bool failed;                  // whether an error ended the input
+};
+
+// Helper function
+// Input tokenizer: The Tokenizer that found an error.
+// Input message: The error message, which may show the character ch with %c.
+// Input ch: The character the error is about.
+// Return: NULL, the end of the input, if tokenizer recovers from errors.
+// Otherwise the message is printed and the program cleanly exits.
+static Object *tokenError(Tokenizer *tokenizer, const char *message, int ch){
+    if (tokenizer->recover) {
+        tokenizer->failed = true;
+        tokenizer->ch = EOF;
+        return NULL;
+    }
+    printf(message, ch);
+    printf("\n");
+    texit(1);
+    return NULL;
+}
+
+// Input path: The path of a file with a Scheme program, or NULL to read
+// standard input (stdin).
+// Return: A new Tokenizer that reads from there.
+Tokenizer *tokenizerOpen(char *path){
+    int fd = STDIN_FILENO;
+    if (path != NULL) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            printf("Error: cannot open %s\n", path);
+            texit(1);
+        }
+    }
+    Tokenizer *tokenizer = malloc(sizeof(Tokenizer));
+    if (tokenizer == NULL) {
+        printf("Syntax error: out of memory\n");
+        texit(1);
+    }
+    readerOpen(&tokenizer->reader, fd);
+    tokenizer->buffer = (TokenBuffer){NULL, 0, 0};
+    tokenizer->ch = NO_CHAR;
+    tokenizer->fd = path != NULL ? fd : -1;
+    tokenizer->recover = false;
+    tokenizer->failed = false;
+    return tokenizer;
+}
+
+// Input text: The characters of a Scheme program, which must stay in place
+// until the tokenizer is closed.
+// Input length: The number of characters in text.
+// Input recover: Whether an error should end the input instead of the program
+// (see tokenizerFailed).
+// Return: A new Tokenizer that reads text.
+Tokenizer *tokenizerOpenBuffer(const char *text, size_t length, bool recover){
+    Tokenizer *tokenizer = malloc(sizeof(Tokenizer));
+    if (tokenizer == NULL) {
+        printf("Syntax error: out of memory\n");
+        texit(1);
+    }
+    memset(&tokenizer->reader, 0, sizeof(Reader));
+    tokenizer->reader.ptr = (const unsigned char *)text;
+    tokenizer->reader.end = (const unsigned char *)text + length;
+    tokenizer->reader.fd = -1;
+    tokenizer->buffer = (TokenBuffer){NULL, 0, 0};
+    tokenizer->ch = NO_CHAR;
+    tokenizer->fd = -1;
+    tokenizer->recover = recover;
+    tokenizer->failed = false;
+    return tokenizer;
+}
+
+// Input source: Where to store the program.
+// Input path: The path of a file with a Scheme program, or NULL to read
+// standard input (stdin).
+// Reads the whole program into memory. A regular file is mapped as a whole.
+void readSource(Source *source, char *path){
+    int fd = STDIN_FILENO;
+    if (path != NULL){
+        fd = open(path, O_RDONLY);
+        if (fd < 0){
+            printf("Error: cannot open %s\n", path);
+            texit(1);
+        }
+    }
+    source->text = NULL;
+    source->length = 0;
+    source->mapped = false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && lseek(fd, 0, SEEK_CUR) == 0){
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED){
+            source->text = map;
+            source->length = st.st_size;
+            source->mapped = true;
+        }
+    }
+
+    size_t capacity = 0;
+    while (!source->mapped){
+        if (capacity - source->length < READ_BLOCK){
+            capacity = capacity == 0 ? 4 * READ_BLOCK : capacity * 2;
+            source->text = realloc(source->text, capacity);
+            if (source->text == NULL){
+                printf("Syntax error: out of memory\n");
+                texit(1);
+            }
+        }
+        ssize_t count = read(fd, source->text + source->length, READ_BLOCK);
+        if (count < 0 && errno == EINTR){
+            continue;
+        }
+        if (count <= 0){
+            break;
+        }
+        source->length += count;
+    }
+    if (path != NULL){
+        close(fd);
+    }
+}
+
+// Helper function
+// Input source: A program read with readSource.
+// Gives back the memory of source. Tokens never point into it.
+void closeSource(Source *source){
+    if (source->mapped){
+        munmap(source->text, source->length);
+    }
+    else {
+        free(source->text);
+    }
+}
+
+// Input fd: An open file.
+// Input data: The bytes to write.
+// Input count: The number of bytes to write.
+// Return: True if all of them were written. A write that is cut short or
+// interrupted is carried on.
+bool writeAll(int fd, const void *data, size_t count){
+    const char *ptr = data;
+    while (count > 0) {
+        ssize_t written = write(fd, ptr, count);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        ptr += written;
+        count -= written;
+    }
+    return true;
+}
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpenBuffer.
+// Return: True if the input ended early because of an error.
+bool tokenizerFailed(Tokenizer *tokenizer){
+    return tokenizer->failed;
+}
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Closes tokenizer and gives back its memory. Tokens stay valid.
+void tokenizerClose(Tokenizer *tokenizer){
+    readerClose(&tokenizer->reader);
+    free(tokenizer->buffer.data);
+    if (tokenizer->fd >= 0) {
+        close(tokenizer->fd);
+    }
+    free(tokenizer);
+}
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Return: The next token, or NULL at the end of the input. Only as much input
+// is read as it takes to find the end of the token.
+Object *nextToken(Tokenizer *tokenizer){
+    Reader *reader = &tokenizer->reader;
+    TokenBuffer *buffer = &tokenizer->buffer;
+    int ch = tokenizer->ch == NO_CHAR ? nextChar(reader) : tokenizer->ch;
     objectType type = NULL_TYPE;  // type of token being built in buffer
-    Object *list = makeNull();
+    Object *token = NULL;
 
-    ch = fgetc(stdin);
-    while (ch != EOF) {
+    while (token == NULL && ch != EOF) {
 
         // Skip whitespace
-        if (isspace(ch)) {
-            ch = fgetc(stdin);
+        if (ch != EOF && (charClass[ch] & CHAR_SPACE)) {
+            reader->ptr = skipSpace(reader->ptr, reader->end);
+            ch = nextChar(reader);
         }
 
         // Handle open parenthesis
         else if (ch == '(') {
-            Object *openToken = makeOpenToken();
-            list = cons(openToken, list);
-            ch = fgetc(stdin);
+            token = OPEN_OBJECT;
+            ch = NO_CHAR;
         }
 
         // Handle close parenthesis
         else if (ch == ')') {
-            Object *closeToken = makeCloseToken();
-            list = cons(closeToken, list);
-            ch = fgetc(stdin);
+            token = CLOSE_OBJECT;
+            ch = NO_CHAR;
         }
 
         // Handle close brace
         else if (ch == '}') {
-            Object *closeBraceToken = makeCloseBraceToken();
-            list = cons(closeBraceToken, list);
-            ch = fgetc(stdin);
+            token = CLOSEBRACE_OBJECT;
+            ch = NO_CHAR;
         }
 
         // Handle boolean
         else if (ch == '#') {
-            ch = fgetc(stdin);
+            ch = nextChar(reader);
             if (ch == 't'){
-                Boolean *booleanToken = makeBooleanToken();
-                booleanToken->value = 1;
-                list = cons((Object *)booleanToken, list);
-                ch = fgetc(stdin);
+                token = TRUE_OBJECT;
+                ch = NO_CHAR;
             }
             else if (ch == 'f'){
-                Boolean *booleanToken = makeBooleanToken();
-                booleanToken->value = 0;
-                list = cons((Object *)booleanToken, list);
-                ch = fgetc(stdin);
+                token = FALSE_OBJECT;
+                ch = NO_CHAR;
             }
             else {
-                printf("Syntax error\n");
-                texit(1);
+                return tokenError(tokenizer, "Syntax error", ch);
             }
         }
 
         // Handle integer or double that start with a digit
         else if (isdigit(ch)) {
             // Collect integer or double token
-            index = 0;
-            buffer[index++] = ch;
-            ch = fgetc(stdin);
+            buffer->length = 0;
+            bufferPush(buffer, ch);
+            ch = nextChar(reader);
             type = 0; //0 if integer, 1 if double
 
             // Read in digits or decimal points
@@ -154,72 +513,65 @@ Object *tokenize(){
                 if (ch == '.'){
                     type = 1;
                 }
-                buffer[index++] = ch;
-                ch = fgetc(stdin);
+                bufferPush(buffer, ch);
+                ch = nextChar(reader);
             }
-            buffer[index] = '\0';
+            bufferTerminate(buffer);
 
             
             if (type == 1) {
                 // It's a double
-                double dvalue = atof(buffer);
+                double dvalue = atof(buffer->data);
                 Double *doubleToken = makeDoubleToken();
                 doubleToken->value = dvalue;
-                list = cons((Object *)doubleToken, list);
+                token = (Object *)doubleToken;
             } 
             else if (type == 0){
                 // It's an integer
-                int ivalue = atoi(buffer);
-                Integer *intToken = makeIntToken();
-                intToken->value = ivalue;
-                list = cons((Object *)intToken, list);
+                int ivalue = atoi(buffer->data);
+                token = makeInteger(ivalue);
             }
             else {
-                printf("Syntax error\n");
-                texit(1);
+                return tokenError(tokenizer, "Syntax error", ch);
             }
         }
 
         // Handle double starts with '.'
         else if (ch == '.') {
             // Collect integer or double token
-            index = 0;
-            buffer[index++] = ch;
-            ch = fgetc(stdin);
+            buffer->length = 0;
+            bufferPush(buffer, ch);
+            ch = nextChar(reader);
 
             if (isdigit(ch) == false) {
-                printf("Syntax error\n");
-                texit(1);
+                return tokenError(tokenizer, "Syntax error", ch);
             }
 
             // Read in digits or decimal points
             while (isdigit(ch)) {
-                buffer[index++] = ch;
-                ch = fgetc(stdin);
+                bufferPush(buffer, ch);
+                ch = nextChar(reader);
             }
-            buffer[index] = '\0';
+            bufferTerminate(buffer);
             
-            double dvalue = atof(buffer);
+            double dvalue = atof(buffer->data);
             Double *doubleToken = makeDoubleToken();
             doubleToken->value = dvalue;
-            list = cons((Object *)doubleToken, list);
+            token = (Object *)doubleToken;
            
         }
 
         // Handle integers, doubles, or possible symbol that start with "+" or "-"
         else if (ch == '-' || ch == '+') {
             // Collect integer or double token
-            index = 0;
-            buffer[index++] = ch;
-            ch = fgetc(stdin);
+            buffer->length = 0;
+            bufferPush(buffer, ch);
+            ch = nextChar(reader);
             type = 0; //0 if integer, 1 if double
 
             if (isspace(ch) || ch == ')' || ch == '}'){
-                buffer[index++] = '\0';
-                Symbol *symbolToken = makeSymbolToken();
-                symbolToken->value = (char *)talloc(strlen(buffer) + 1);
-                strcpy(symbolToken->value,buffer);
-                list = cons((Object *)symbolToken, list);
+                Symbol *symbolToken = intern(buffer->data, buffer->length);
+                token = (Object *)symbolToken;
             }
             else if (isdigit(ch)){
                 // Read in digits or decimal points
@@ -227,34 +579,30 @@ Object *tokenize(){
                     if (ch == '.'){
                         type = 1;
                     }
-                    buffer[index++] = ch;
-                    ch = fgetc(stdin);
+                    bufferPush(buffer, ch);
+                    ch = nextChar(reader);
                 }
-                buffer[index] = '\0';
+                bufferTerminate(buffer);
 
                 
                 if (type == 1) {
                     // It's a double
-                    double dvalue = atof(buffer);
+                    double dvalue = atof(buffer->data);
                     Double *doubleToken = makeDoubleToken();
                     doubleToken->value = dvalue;
-                    list = cons((Object *)doubleToken, list);
+                    token = (Object *)doubleToken;
                 } 
                 else if (type == 0){
                     // It's an integer
-                    int ivalue = atoi(buffer);
-                    Integer *intToken = makeIntToken();
-                    intToken->value = ivalue;
-                    list = cons((Object *)intToken, list);
+                    int ivalue = atoi(buffer->data);
+                    token = makeInteger(ivalue);
                 }
                 else {
-                    printf("Syntax error\n");
-                    texit(1);
+                    return tokenError(tokenizer, "Syntax error", ch);
                 }
             }
             else{
-                printf("Syntax error\n");
-                texit(1);
+                return tokenError(tokenizer, "Syntax error", ch);
             }
 
             
@@ -262,24 +610,26 @@ Object *tokenize(){
 
         // Handle strings
         else if (ch == '"') {
-            index = 0;
-            ch = fgetc(stdin); 
+            buffer->length = 0;
+            ch = nextChar(reader); 
 
             while (ch != '"' && ch != EOF) {
-                buffer[index++] = ch;
-                ch = fgetc(stdin);
+                bufferPush(buffer, ch);
+                const unsigned char *quote = findChar(reader->ptr, reader->end, '"');
+                bufferAppend(buffer, reader->ptr, quote - reader->ptr);
+                reader->ptr = quote;
+                ch = nextChar(reader);
             }
-            buffer[index] = '\0'; 
+            bufferTerminate(buffer);
 
             if (ch == '"') {
                 String *strToken = makeStringToken();
-                strToken->value = (char *)talloc(strlen(buffer) + 1);
-                strcpy(strToken->value,buffer);
-                list = cons((Object *)strToken, list);
-                ch = fgetc(stdin);
+                strToken->value = (char *)talloc(buffer->length + 1);
+                memcpy(strToken->value, buffer->data, buffer->length + 1);
+                token = (Object *)strToken;
+                ch = NO_CHAR;
             } else {
-                printf("Syntax error: Unterminated string\n");
-                texit(1);
+                return tokenError(tokenizer, "Syntax error: Unterminated string", ch);
             }
         }
 
@@ -287,77 +637,99 @@ Object *tokenize(){
         else if (ch == ';') {
             // Skip until newline
             while (ch != '\n' && ch != EOF) {
-                ch = fgetc(stdin);
+                reader->ptr = findChar(reader->ptr, reader->end, '\n');
+                ch = nextChar(reader);
             }
         }
 
         // Handle symbols (can start with letters or special characters)
-        else if (isalpha(ch) || strchr("!$%&*/:<=>?~_^", ch)) {
-            index = 0;
-            buffer[index++] = ch;
-            ch = fgetc(stdin);
-
-            while (isalnum(ch)|| strchr("!$%&*/:<=>?~_^+-", ch)) {
-                buffer[index++] = ch;
-                ch = fgetc(stdin);
+        else if (charClass[ch] & CHAR_SYMBOL_START) {
+            buffer->length = 0;
+            bufferPush(buffer, ch);
+            ch = nextChar(reader);
+
+            while (ch != EOF && (charClass[ch] & CHAR_SYMBOL)) {
+                bufferPush(buffer, ch);
+                ch = nextChar(reader);
             }
-            buffer[index] = '\0'; 
 
-            Symbol *symbolToken = makeSymbolToken();
-            symbolToken->value = (char *)talloc(strlen(buffer) + 1);
-            strcpy(symbolToken->value,buffer);
-            list = cons((Object *)symbolToken, list);
+            Symbol *symbolToken = intern(buffer->data, buffer->length);
+            token = (Object *)symbolToken;
         }
 
         // Handle syntax error
         else {
-            printf("Syntax error: Unrecognized character '%c'\n", ch);
-            texit(1);
+            return tokenError(tokenizer, "Syntax error: Unrecognized character '%c'", ch);
         }
     }
 
+    tokenizer->ch = ch;
+    return token;
+}
+
+// Helper function
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Return: A list of all the tokens that are left in tokenizer.
+static Object *tokenizeAll(Tokenizer *tokenizer){
+    Object *list = NULL_OBJECT;
+    Object *token;
+    while ((token = nextToken(tokenizer)) != NULL) {
+        list = cons(token, list);
+    }
+    tokenizerClose(tokenizer);
     return reverse(list);
 }
 
+// Return: A cons cell that is the head of a list. The list consists of the 
+// tokens read from standard input (stdin).
+Object *tokenize(){
+    return tokenizeAll(tokenizerOpen(NULL));
+}
+
+// Input path: The path of a file with a Scheme program.
+// Return: A cons cell that is the head of a list. The list consists of the
+// tokens read from the file.
+Object *tokenizeFile(char *path){
+    return tokenizeAll(tokenizerOpen(path));
+}
+
 // Input list: A list of tokens, as returned from the tokenize function.
 // Prints the tokens, one per line with type annotation, as exemplified in the 
 // assignment.
 void displayTokens(Object *list){
-    while (list->type != NULL_TYPE) {
+    while (list != NULL_OBJECT) {
         Object *token = car(list);
 
-        if (token->type == INT_TYPE) {
-            Integer *intToken = (Integer *)token;
-            printf("%d:integer\n", intToken->value);
+        if (typeOf(token) == INT_TYPE) {
+            printf("%d:integer\n", intValue(token));
         } 
-        else if (token->type == DOUBLE_TYPE) {
+        else if (typeOf(token) == DOUBLE_TYPE) {
             Double *doubleToken = (Double *)token;
             printf("%f:double\n", doubleToken->value);
         } 
-        else if (token->type == STR_TYPE) {
+        else if (typeOf(token) == STR_TYPE) {
             String *strToken = (String *)token;
             printf("\"%s\":string\n", strToken->value);
         } 
-        else if (token->type == SYMBOL_TYPE) {
+        else if (typeOf(token) == SYMBOL_TYPE) {
             Symbol *symbolToken = (Symbol *)token;
             printf("%s:symbol\n", symbolToken->value);
         } 
-        else if (token->type == BOOL_TYPE) {
-            Boolean *boolToken = (Boolean *)token;
-            if (boolToken->value == 0){
+        else if (typeOf(token) == BOOL_TYPE) {
+            if (boolValue(token) == 0){
                 printf("#f:boolean\n");
             }
-            else if (boolToken->value == 1){
+            else if (boolValue(token) == 1){
                 printf("#t:boolean\n");
             }
         } 
-        else if (token->type == OPEN_TYPE) {
+        else if (token == OPEN_OBJECT) {
             printf("(:open\n");
         } 
-        else if (token->type == CLOSE_TYPE) {
+        else if (token == CLOSE_OBJECT) {
             printf("):close\n");
         } 
-        else if (token->type == CLOSEBRACE_TYPE) {
+        else if (token == CLOSEBRACE_OBJECT) {
             printf("}:closebrace\n");
         } 
 
@@ -10,6 +10,64 @@
 // tokens read from standard input (stdin).
 Object *tokenize();
 
+// Input path: The path of a file with a Scheme program.
+// Return: A cons cell that is the head of a list. The list consists of the
+// tokens read from the file.
+Object *tokenizeFile(char *path);
+
+// A source of tokens that are read one at a time (see nextToken).
+typedef struct Tokenizer Tokenizer;
+
+// Input path: The path of a file with a Scheme program, or NULL to read
+// standard input (stdin).
+// Return: A new Tokenizer that reads from there.
+Tokenizer *tokenizerOpen(char *path);
+
+// Input text: The characters of a Scheme program, which must stay in place
+// until the tokenizer is closed.
+// Input length: The number of characters in text.
+// Input recover: Whether an error should end the input instead of the program
+// (see tokenizerFailed).
+// Return: A new Tokenizer that reads text.
+Tokenizer *tokenizerOpenBuffer(const char *text, size_t length, bool recover);
+
+// A whole program in memory (see readSource).
+typedef struct Source {
+    char *text;
+    size_t length;
+    bool mapped;                // whether text is mapped rather than malloced
+} Source;
+
+// Input source: Where to store the program.
+// Input path: The path of a file with a Scheme program, or NULL to read
+// standard input (stdin).
+// Reads the whole program into memory. A regular file is mapped as a whole.
+void readSource(Source *source, char *path);
+
+// Input source: A program read with readSource.
+// Gives back the memory of source. Tokens never point into it.
+void closeSource(Source *source);
+
+// Input fd: An open file.
+// Input data: The bytes to write.
+// Input count: The number of bytes to write.
+// Return: True if all of them were written. A write that is cut short or
+// interrupted is carried on.
+bool writeAll(int fd, const void *data, size_t count);
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpenBuffer.
+// Return: True if the input ended early because of an error.
+bool tokenizerFailed(Tokenizer *tokenizer);
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Return: The next token, or NULL at the end of the input. Only as much input
+// is read as it takes to find the end of the token.
+Object *nextToken(Tokenizer *tokenizer);
+
+// Input tokenizer: A Tokenizer, as returned from tokenizerOpen.
+// Closes tokenizer and gives back its memory. Tokens stay valid.
+void tokenizerClose(Tokenizer *tokenizer);
+
 // Input list: A list of tokens, as returned from the tokenize function.
 // Prints the tokens, one per line with type annotation, as exemplified in the 
 // assignment.
@@ -0,0 +1,353 @@
+// vm.c by Leon Liang
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "object.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "gc.h"
+#include "frame.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include "vm.h"
+
+// Where a call returns to: the code and the next instruction of the caller,
+// and the height of the stack when the call was made. The closure and frame of
+// the caller are kept in the two entries of the stack at base, where the
+// collector sees them; the stack of the callee starts right after them.
+typedef struct VmCall {
+    Code *code;
+    uint32_t *pc;
+    size_t base;
+} VmCall;
+
+// The stack of values, shared by all calls of vmExecute. It is a root of
+// every collection, as far up as stackTop.
+static Object **stack = NULL;
+static size_t stackTop = 0;
+static size_t stackCapacity = 0;
+
+static VmCall *calls = NULL;
+static size_t callCount = 0;
+static size_t callCapacity = 0;
+
+// Helper function
+// Input entries: How many more entries the stack needs above stackTop.
+// Makes room for them. The stack may move.
+static void reserve(size_t entries){
+    if (stackTop + entries <= stackCapacity) {
+        return;
+    }
+    if (stack == NULL) {
+        gcAddRootArray(&stack, &stackTop);
+    }
+    while (stackTop + entries > stackCapacity) {
+        stackCapacity = stackCapacity == 0 ? 1024 : 2 * stackCapacity;
+    }
+    stack = realloc(stack, stackCapacity * sizeof(Object *));
+    if (stack == NULL) {
+        printf("Evaluation error: out of memory\n");
+        texit(1);
+    }
+}
+
+// Helper function
+// Remember where a call returns to
+static void pushCall(Code *code, uint32_t *pc, size_t base){
+    if (callCount == callCapacity) {
+        callCapacity = callCapacity == 0 ? 256 : 2 * callCapacity;
+        calls = realloc(calls, callCapacity * sizeof(VmCall));
+        if (calls == NULL) {
+            printf("Evaluation error: out of memory\n");
+            texit(1);
+        }
+    }
+    calls[callCount].code = code;
+    calls[callCount].pc = pc;
+    calls[callCount].base = base;
+    callCount++;
+}
+
+// Helper function
+// Make the frame of a call of a closure, like bindArguments, with the
+// arguments taken from the stack instead of a list
+static Frame *bindStack(Closure *closure, Code *code, Object **args, uint32_t count){
+    if (count != (uint32_t)code->paramCount) {
+        evaluationError();
+    }
+    Frame *frame = makeFrame(closure->frame, closure->paramNames, count);
+    Object *param = closure->paramNames;
+    for (uint32_t i = 0; i < count; i++) {
+        frameAddSlot(frame, car(param), args[i]);
+        param = cdr(param);
+    }
+    return frame;
+}
+
+// Helper function
+// Input code: The code to run.
+// Input frame: The frame to run it in.
+// Input function: The closure whose body code is, or NULL.
+// Return: The value the code returns. Calls from Scheme code to closures
+// stay in the loop below; only primitives that call closures, such as map,
+// come back in through vmApply. The stack is synced to stackTop whenever the
+// collector might run or the stack might move.
+static Object *vmExecute(Code *code, Frame *frame, Object *function){
+    Frame *env = frame;
+    Object *closure = function;
+    gcPushRoot(&env);
+    gcPushRoot(&closure);
+
+    // A call with no caller, which the last return leaves the loop through
+    reserve(code->maxStack + 2);
+    pushCall(NULL, NULL, stackTop);
+    stack[stackTop++] = NULL;
+    stack[stackTop++] = NULL;
+    gcMaybeCollect();
+
+    Object **sp = stack + stackTop;
+    uint32_t *pc = code->words;
+    Object *result = NULL;
+
+#define SYNC() (stackTop = sp - stack)
+#define RELOAD() (sp = stack + stackTop)
+
+    // The instructions are dispatched with a jump through a table of labels at
+    // the end of each one (threaded code), where the compiler supports it
+#ifdef __GNUC__
+    static void *labels[NUM_OPS] = {
+        [OP_CONST] = &&TARGET_OP_CONST,
+        [OP_LOCAL] = &&TARGET_OP_LOCAL,
+        [OP_LOOKUP] = &&TARGET_OP_LOOKUP,
+        [OP_POP] = &&TARGET_OP_POP,
+        [OP_JUMP] = &&TARGET_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&TARGET_OP_JUMP_IF_FALSE,
+        [OP_LET] = &&TARGET_OP_LET,
+        [OP_END_LET] = &&TARGET_OP_END_LET,
+        [OP_DEFINE_CHECK] = &&TARGET_OP_DEFINE_CHECK,
+        [OP_DEFINE] = &&TARGET_OP_DEFINE,
+        [OP_CLOSURE] = &&TARGET_OP_CLOSURE,
+        [OP_CALL] = &&TARGET_OP_CALL,
+        [OP_TAIL_CALL] = &&TARGET_OP_TAIL_CALL,
+        [OP_RETURN] = &&TARGET_OP_RETURN,
+        [OP_ERROR] = &&TARGET_OP_ERROR,
+    };
+#define TARGET(op) TARGET_##op
+#define DISPATCH() goto *labels[*pc++]
+#else
+#define TARGET(op) case op
+#define DISPATCH() goto dispatch
+#endif
+
+    bool tail;
+    DISPATCH();
+#ifndef __GNUC__
+dispatch:
+    switch (*pc++) {
+#endif
+    TARGET(OP_CONST):
+        *sp++ = code->constants[pc[0]];
+        pc += 1;
+        DISPATCH();
+
+    TARGET(OP_LOCAL): {
+        Frame *current = env;
+        for (uint32_t depth = pc[0]; depth > 0; depth--) {
+            current = current->parent;
+        }
+        *sp++ = current->slots[pc[1]];
+        pc += 2;
+        DISPATCH();
+    }
+
+    TARGET(OP_LOOKUP): {
+        Object *symbol = code->constants[pc[0]];
+        Object **value = NULL;
+        for (Frame *current = env; current != NULL; current = current->parent) {
+            value = frameLookup(current, symbol);
+            if (value != NULL) {
+                break;
+            }
+        }
+        if (value == NULL) {
+            evaluationError();
+        }
+        *sp++ = *value;
+        pc += 1;
+        DISPATCH();
+    }
+
+    TARGET(OP_POP):
+        sp--;
+        DISPATCH();
+
+    TARGET(OP_JUMP):
+        pc = code->words + pc[0];
+        DISPATCH();
+
+    TARGET(OP_JUMP_IF_FALSE):
+        if (*--sp == FALSE_OBJECT) {
+            pc = code->words + pc[0];
+        }
+        else {
+            pc += 1;
+        }
+        DISPATCH();
+
+    TARGET(OP_LET): {
+        Object *pairs = code->constants[pc[0]];
+        uint32_t count = pc[1];
+        Frame *letFrame = makeFrame(env, pairs, count);
+        sp -= count;
+        for (uint32_t i = 0; i < count; i++) {
+            frameAddSlot(letFrame, car(car(pairs)), sp[i]);
+            pairs = cdr(pairs);
+        }
+        *sp++ = (Object *)env;
+        env = letFrame;
+        pc += 2;
+        DISPATCH();
+    }
+
+    TARGET(OP_END_LET):
+        env = (Frame *)sp[-2];
+        sp[-2] = sp[-1];
+        sp--;
+        DISPATCH();
+
+    TARGET(OP_DEFINE_CHECK):
+        if (frameLookup(env, code->constants[pc[0]]) != NULL) {
+            evaluationError();
+        }
+        pc += 1;
+        DISPATCH();
+
+    TARGET(OP_DEFINE):
+        frameBind(env, code->constants[pc[0]], sp[-1]);
+        sp[-1] = VOID_OBJECT;
+        pc += 1;
+        DISPATCH();
+
+    TARGET(OP_CLOSURE): {
+        Closure *made = tallocPool(CLOSURE_POOL);
+        made->type = CLOSURE_TYPE;
+        made->paramNames = code->constants[pc[0]];
+        made->functionCode = code->constants[pc[1]];
+        made->frame = env;
+        made->code = code->lambdas[pc[2]];
+        *sp++ = (Object *)made;
+        pc += 3;
+        DISPATCH();
+    }
+
+    TARGET(OP_CALL):
+        tail = false;
+        goto call;
+
+    TARGET(OP_TAIL_CALL):
+        tail = true;
+        goto call;
+
+    call: {
+        uint32_t count = pc[0];
+        pc += 1;
+        Object **args = sp - count;
+        Object *callee = args[-1];
+        if (typeOf(callee) == CLOSURE_TYPE) {
+            Code *calleeCode = closureCode((Closure *)callee);
+            Frame *calleeFrame = bindStack((Closure *)callee, calleeCode, args, count);
+            size_t base;
+            if (tail) {
+                base = calls[callCount - 1].base;
+            }
+            else {
+                base = (args - 1) - stack;
+                pushCall(code, pc, base);
+                stack[base] = closure;
+                stack[base + 1] = (Object *)env;
+            }
+            closure = callee;
+            env = calleeFrame;
+            code = calleeCode;
+            pc = code->words;
+            stackTop = base + 2;
+            reserve(code->maxStack + 2);
+            gcMaybeCollect();
+            RELOAD();
+            DISPATCH();
+        }
+        if (typeOf(callee) != PRIMITIVE_TYPE) {
+            evaluationError(); // Not a function
+        }
+        Object *list = NULL_OBJECT;
+        for (uint32_t i = count; i > 0; i--) {
+            list = cons(args[i - 1], list);
+        }
+        // The function and arguments stay on the stack while the primitive
+        // runs, since primitives such as map call back into the machine
+        SYNC();
+        result = ((Primitive *)callee)->pf(list);
+        RELOAD();
+        sp -= count + 1;
+        *sp++ = result;
+        if (!tail) {
+            DISPATCH();
+        }
+    }
+    // A tail call of a primitive returns its value
+    // fall through
+
+    TARGET(OP_RETURN): {
+        result = sp[-1];
+        VmCall *call = &calls[--callCount];
+        sp = stack + call->base;
+        closure = sp[0];
+        env = (Frame *)sp[1];
+        if (call->code == NULL) {
+            goto done;
+        }
+        code = call->code;
+        pc = call->pc;
+        *sp++ = result;
+        DISPATCH();
+    }
+
+    TARGET(OP_ERROR):
+        evaluationError();
+        DISPATCH();
+#ifndef __GNUC__
+    }
+#endif
+
+done:
+#undef TARGET
+#undef DISPATCH
+#undef SYNC
+#undef RELOAD
+
+    stackTop = sp - stack;
+    gcPopRoots(2);
+    return result;
+}
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Input frame: The frame to evaluate it in.
+// Return: The value of tree, as eval would compute it. The expression is
+// compiled to bytecode (see bytecode.h), which a stack machine then runs.
+Object *vmEval(Object *tree, Frame *frame){
+    Code *code = compileExpression(tree);
+    gcAddRootArray(&code->constants, &code->constantCount);
+    Object *result = vmExecute(code, frame, NULL);
+    gcRemoveRootArray(&code->constants);
+    codeFree(code);
+    return result;
+}
+
+// Input function: A closure.
+// Input frame: A frame for a call of function, with the arguments bound to
+// its parameters.
+// Return: The value of the body of function in frame. Used by primitives such
+// as map, which call closures with arguments of their own.
+Object *vmApply(Object *function, Frame *frame){
+    return vmExecute(closureCode((Closure *)function), frame, function);
+}
@@ -0,0 +1,19 @@
+#include "object.h"
+
+#ifndef _VM
+#define _VM
+
+// Input tree: A top-level expression, resolved (see resolve.h).
+// Input frame: The frame to evaluate it in.
+// Return: The value of tree, as eval would compute it. The expression is
+// compiled to bytecode (see bytecode.h), which a stack machine then runs.
+Object *vmEval(Object *tree, Frame *frame);
+
+// Input function: A closure.
+// Input frame: A frame for a call of function, with the arguments bound to
+// its parameters.
+// Return: The value of the body of function in frame. Used by primitives such
+// as map, which call closures with arguments of their own.
+Object *vmApply(Object *function, Frame *frame);
+
+#endif